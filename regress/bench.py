@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+
+# Measure how fast trrntzip processes a generated corpus, and compare with
+# the results of an earlier run.
+#
+# The corpus has sets of zips of different shapes. Each scenario runs
+# trrntzip on each set: checking TorrentZipped zips (-c), skipping them,
+# rezipping ones which only need reordering, and rezipping ones from
+# other tools. The best of a few runs counts. With a baseline, exits with
+# 1 if any scenario got slower by more than the tolerance.
+
+import argparse
+import fnmatch
+import json
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import zipfile
+import zlib
+
+from corpus import KINDS, SIZES, mixed, noise, text
+
+# Bump when the generated corpus changes, so kept ones get replaced
+CORPUS_VERSION = 1
+
+DATE = (1996, 12, 24, 23, 32, 0)
+
+# Scenarios are run until they took this long in total, or often enough
+MIN_SECONDS = 1
+MAX_RUNS = 50
+
+# Differences smaller than this are noise, however many percent they are
+NOISE_SECONDS = 0.01
+
+
+def add(z, name, data, method):
+    info = zipfile.ZipInfo(name, DATE)
+    info.compress_type = method
+    z.writestr(info, data)
+
+
+def method(rnd):
+    # stored members get deflated, deflated ones inflated first
+    return zipfile.ZIP_DEFLATED if rnd.random() < 0.7 else zipfile.ZIP_STORED
+
+
+def make_tiny(directory, rnd, scale):
+    # many archives of many tiny members, where per member costs show
+    for i in range(100 * scale):
+        with zipfile.ZipFile(os.path.join(directory, 'tiny%04d.zip' % i),
+                             'w') as z:
+            for member in range(rnd.randrange(50, 300)):
+                kind = rnd.choice(KINDS)
+                add(z, '%s/%04d.bin' % (kind.__name__, member),
+                    kind(rnd, rnd.randrange(0, 512)), method(rnd))
+
+
+def make_huge(directory, rnd, scale):
+    # one member big enough to be streamed instead of built in memory
+    with zipfile.ZipFile(os.path.join(directory, 'huge.zip'), 'w') as z:
+        add(z, 'huge.bin', mixed(rnd, 64 * scale << 20), zipfile.ZIP_DEFLATED)
+
+
+def make_wide(directory, rnd, scale):
+    # 100000 entries, sorting and the central directory dominate
+    with zipfile.ZipFile(os.path.join(directory, 'wide.zip'), 'w') as z:
+        for i in range(100000):
+            add(z, 'd%02d/f%06d.txt' % (i % 50, i),
+                text(rnd, rnd.randrange(0, 64)), zipfile.ZIP_DEFLATED)
+
+
+def make_deep(directory, rnd, scale):
+    # small archives in deep directory trees, for the walker
+    for branch in range(4 * scale):
+        path = os.path.join(directory, 'b%02d' % branch)
+        for level in range(24):
+            path = os.path.join(path, 'l%02d' % level)
+            os.makedirs(path)
+            for i in range(2):
+                with zipfile.ZipFile(os.path.join(path, 'z%d.zip' % i),
+                                     'w') as z:
+                    for member in range(rnd.randrange(1, 8)):
+                        add(z, 'f%d.txt' % member,
+                            text(rnd, rnd.randrange(0, 4096)), method(rnd))
+
+
+def make_mixed(directory, rnd, scale):
+    # typical archives, data from text to incompressible noise
+    for i in range(40 * scale):
+        with zipfile.ZipFile(os.path.join(directory, 'mixed%03d.zip' % i),
+                             'w') as z:
+            for member in range(rnd.randrange(1, 20)):
+                if rnd.random() < 0.3:
+                    size = rnd.choice(SIZES)
+                else:
+                    size = int(rnd.expovariate(1 / (128 * 1024)))
+                kind = rnd.choice(KINDS + [noise])
+                add(z, '%s/%04d.bin' % (kind.__name__, member),
+                    kind(rnd, size), method(rnd))
+
+
+SETS = [('tiny', make_tiny), ('huge', make_huge), ('wide', make_wide),
+        ('deep', make_deep), ('mixed', make_mixed)]
+
+
+def zips(directory):
+    return sorted(os.path.join(root, name)
+                  for root, dirs, files in os.walk(directory)
+                  for name in files if name.endswith('.zip'))
+
+
+def reorder(path):
+    # Reverse the central directory of a TorrentZipped zip and fix up the
+    # checksum in its comment, so trrntzip only has to reorder it. Returns
+    # whether that worked.
+    with open(path, 'rb') as f:
+        data = f.read()
+    end = data.rfind(b'PK\5\6')
+    if end < 0 or data[end + 20:end + 22] != b'\x16\0':
+        return False
+    count, size, offset = struct.unpack('<HII', data[end + 10:end + 20])
+    if count < 2 or count == 0xffff or offset == 0xffffffff:
+        return False
+    entries = []
+    pos = offset
+    while pos < offset + size:
+        n, m, k = struct.unpack('<HHH', data[pos + 28:pos + 34])
+        entries.append(data[pos:pos + 46 + n + m + k])
+        pos += 46 + n + m + k
+    central = b''.join(reversed(entries))
+    comment = b'TORRENTZIPPED-%08X' % zlib.crc32(central)
+    with open(path, 'wb') as f:
+        f.write(data[:offset] + central + data[end:end + 20] +
+                struct.pack('<H', len(comment)) + comment)
+    return True
+
+
+def run(binary, args, paths):
+    start = time.perf_counter()
+    proc = subprocess.run([binary, '-g', '-l', '-e'] + args + paths,
+                          stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    seconds = time.perf_counter() - start
+    if proc.returncode:
+        sys.stderr.write(proc.stderr.decode(errors='replace'))
+        raise RuntimeError('%s failed with %d' % (binary, proc.returncode))
+    return seconds
+
+
+def make_corpus(corpus, binary, scale, seed):
+    # Generated zips in src, TorrentZipped in tz, then reordered in reorder
+    manifest = {'version': CORPUS_VERSION, 'scale': scale, 'seed': seed}
+    try:
+        with open(os.path.join(corpus, 'manifest.json')) as f:
+            if json.load(f) == manifest:
+                return
+    except (OSError, ValueError):
+        pass
+
+    print('generating corpus in ' + corpus)
+    if os.path.exists(corpus):
+        shutil.rmtree(corpus)
+    for name, make in SETS:
+        src = os.path.join(corpus, 'src', name)
+        os.makedirs(src)
+        make(src, random.Random('%d %s' % (seed, name)), scale)
+        tz = os.path.join(corpus, 'tz', name)
+        shutil.copytree(src, tz)
+        run(binary, [], [tz])
+        dst = os.path.join(corpus, 'reorder', name)
+        shutil.copytree(tz, dst)
+        # sets without anything to reorder are left out of that scenario
+        if not [path for path in zips(dst) if reorder(path)]:
+            shutil.rmtree(dst)
+    with open(os.path.join(corpus, 'manifest.json'), 'w') as f:
+        json.dump(manifest, f)
+
+
+# name, set of the corpus, options, whether trrntzip changes the zips
+SCENARIOS = [('check', 'tz', ['-c'], False),
+             ('skip', 'tz', [], False),
+             ('reorder', 'reorder', [], True),
+             ('rezip', 'src', [], True)]
+
+
+def bench(binary, corpus, work, args, repeat, only):
+    results = {}
+    for scenario, base, options, changes in SCENARIOS:
+        for name, _ in SETS:
+            key = scenario + '/' + name
+            src = os.path.join(corpus, base, name)
+            if not os.path.isdir(src) or (only and not any(
+                    fnmatch.fnmatch(key, pattern) for pattern in only)):
+                continue
+            paths = zips(src)
+            size = sum(os.path.getsize(path) for path in paths)
+            # runs of a few milliseconds vary a lot, so those are repeated
+            # for a while
+            best = None
+            spent = 0
+            runs = 0
+            while runs < repeat or (spent < MIN_SECONDS and runs < MAX_RUNS):
+                target = src
+                if changes:
+                    target = os.path.join(work, key)
+                    if os.path.exists(target):
+                        shutil.rmtree(target)
+                    shutil.copytree(src, target)
+                seconds = run(binary, options + args, [target])
+                best = seconds if best is None else min(best, seconds)
+                spent += seconds
+                runs += 1
+            results[key] = {'archives': len(paths), 'bytes': size,
+                            'seconds': best}
+    return results
+
+
+def rate(result):
+    return result['bytes'] / result['seconds'] / (1 << 20)
+
+
+def report(results, baseline, tolerance):
+    slower = []
+    print('%-14s %8s %8s %8s %10s %8s %10s %7s' %
+          ('scenario', 'archives', 'MB', 'seconds', 'archives/s', 'MB/s',
+           'baseline', 'change'))
+    for key, result in results.items():
+        line = '%-14s %8d %8.1f %8.3f %10.1f %8.1f' % (
+            key, result['archives'], result['bytes'] / (1 << 20),
+            result['seconds'], result['archives'] / result['seconds'],
+            rate(result))
+        if key in baseline:
+            change = rate(result) / rate(baseline[key]) - 1
+            line += ' %10.1f %+6.1f%%' % (rate(baseline[key]), 100 * change)
+            if change < -tolerance and (result['seconds'] -
+                                        baseline[key]['seconds'] >
+                                        NOISE_SECONDS):
+                slower.append(key)
+                line += ' SLOWER'
+        print(line)
+    return slower
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Measure how fast trrntzip processes a generated corpus.')
+    parser.add_argument('trrntzip', help='trrntzip to measure')
+    parser.add_argument('only', nargs='*',
+                        help='scenarios to run, like rezip/* (default: all)')
+    parser.add_argument('-a', '--args', default='',
+                        help='more options for trrntzip, like '
+                        '--args="-j4 -m4"')
+    parser.add_argument('-b', '--baseline',
+                        help='JSON file with results to compare with')
+    parser.add_argument('-c', '--corpus',
+                        help='directory to keep the corpus in and reuse it')
+    parser.add_argument('-r', '--repeat', type=int, default=3,
+                        help='runs of each scenario, the best counts '
+                        '(default: 3)')
+    parser.add_argument('-s', '--scale', type=int, default=1,
+                        help='multiply the size of the corpus')
+    parser.add_argument('--seed', type=int, default=1,
+                        help='seed for the generated corpus')
+    parser.add_argument('--save', action='store_true',
+                        help='write the results to the baseline instead')
+    parser.add_argument('--require-baseline', action='store_true',
+                        help='exit with 77 (skipped) if there is none')
+    parser.add_argument('-t', '--tolerance', type=float, default=15,
+                        help='percent slower than the baseline that is '
+                        'still fine (default: 15)')
+    args = parser.parse_intermixed_args()
+
+    baseline = {}
+    if args.baseline and not args.save:
+        try:
+            with open(args.baseline) as f:
+                saved = json.load(f)
+            baseline = saved['results']
+            if saved['args'] != args.args or saved['scale'] != args.scale:
+                print('baseline was run with --args="%s" -s %d, '
+                      'not comparing' % (saved['args'], saved['scale']))
+                baseline = {}
+        except FileNotFoundError:
+            if args.require_baseline:
+                print('no baseline %s, run with --save first' %
+                      args.baseline)
+                return 77
+        if args.require_baseline and not baseline:
+            return 77
+
+    binary = os.path.abspath(args.trrntzip)
+    work = tempfile.mkdtemp(prefix='trrntzip-bench.')
+    try:
+        corpus = args.corpus or os.path.join(work, 'corpus')
+        make_corpus(corpus, binary, args.scale, args.seed)
+        results = bench(binary, corpus, work, args.args.split(), args.repeat,
+                        args.only)
+    finally:
+        shutil.rmtree(work)
+
+    slower = report(results, baseline, args.tolerance / 100)
+    if args.save:
+        with open(args.baseline or 'bench-baseline.json', 'w') as f:
+            json.dump({'args': args.args, 'scale': args.scale,
+                       'results': results}, f, indent=1)
+        return 0
+    if slower:
+        print('FAILED: %d of %d scenarios slower than the baseline' %
+              (len(slower), len(results)))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
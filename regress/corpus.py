@@ -0,0 +1,67 @@
+# Generators of deterministic test data for deflate-qualify.py and
+# bench.py: each takes a random.Random and a size and returns that many
+# bytes of some kind of data found in zips.
+
+WORDS = '''the of and to in is was for that with as on by at from his her
+which an be this are or had not but it were have one all they their been
+has its new more who when would there she some other into also two after
+first may time only over years can most made between up than such about
+under then these world through where during any them game level player
+score sprite bank rom chip sound data table address vector'''.split()
+
+
+def text(rnd, size):
+    out = []
+    n = 0
+    while n < size:
+        word = rnd.choice(WORDS)
+        if rnd.random() < 0.1:
+            word = word.capitalize()
+        sep = '\n' if rnd.random() < 0.08 else ' '
+        out.append(word + sep)
+        n += len(word) + 1
+    return ''.join(out).encode('ascii')[:size]
+
+
+def noise(rnd, size):
+    return rnd.getrandbits(8 * size).to_bytes(size, 'little')
+
+
+def runs(rnd, size):
+    # long matches and runs around the 258 byte match limit
+    out = bytearray()
+    while len(out) < size:
+        length = rnd.choice([3, 257, 258, 259, rnd.randrange(1, 2000)])
+        out += bytes([rnd.getrandbits(8)]) * length
+    return bytes(out[:size])
+
+
+def table(rnd, size):
+    # little endian words counting up, like pointer tables in ROMs
+    out = bytearray()
+    value = rnd.getrandbits(16)
+    while len(out) < size:
+        value = (value + rnd.choice([1, 2, 4, 16, 0x100])) & 0xffffffff
+        out += value.to_bytes(4, 'little')
+    return bytes(out[:size])
+
+
+def mixed(rnd, size):
+    out = bytearray()
+    while len(out) < size:
+        kind = rnd.choice([text, noise, runs, table])
+        out += kind(rnd, rnd.randrange(1, 64 * 1024))
+    return bytes(out[:size])
+
+
+def repeat(rnd, size):
+    # the same block over and over, at distances around the window size
+    block = noise(rnd, rnd.choice([32767, 32768, 32769, 1000]))
+    return (block * (size // len(block) + 1))[:size]
+
+
+KINDS = [text, noise, runs, table, mixed, repeat]
+
+# sizes around what deflate treats specially, the rest random
+SIZES = [0, 1, 2, 3, 257, 258, 259, 16383, 16384, 16385, 32767, 32768,
+         32769, 65535, 65536, 65537]
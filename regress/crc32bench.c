@@ -0,0 +1,164 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "crc32.h"
+
+// Check Crc32 against zlib's crc32() and compare their throughput.
+// Usage: crc32bench [-c] [MB]
+//   -c  only check, for the test suite
+//   MB  size of the buffer timed (default: 64)
+
+#define CHECK_SIZE (256 * 1024)
+
+static unsigned long ulSeed = 1;
+
+static unsigned long Random(void) {
+  ulSeed = ulSeed * 1103515245 + 12345;
+  return (ulSeed >> 16) & 0x7fff;
+}
+
+static uLong ZlibCrc(uLong crc, const unsigned char *p, size_t cb) {
+  return crc32(crc, p, (uInt)cb);
+}
+
+static int Check(const unsigned char *p, size_t cb, uLong crcStart) {
+  uLong crcZlib = ZlibCrc(crcStart, p, cb);
+  uLong crc = Crc32(crcStart, p, cb);
+  size_t cbSplit;
+
+  if (crc != crcZlib) {
+    fprintf(stderr, "mismatch at length %lu: %08lx instead of %08lx\n",
+            (unsigned long)cb, crc, crcZlib);
+    return 0;
+  }
+
+  // Continuing a CRC must work, too
+  cbSplit = cb ? Random() % cb : 0;
+  crc = Crc32(Crc32(crcStart, p, cbSplit), p + cbSplit, cb - cbSplit);
+  if (crc != crcZlib) {
+    fprintf(stderr, "mismatch at length %lu split at %lu: %08lx instead "
+            "of %08lx\n", (unsigned long)cb, (unsigned long)cbSplit, crc,
+            crcZlib);
+    return 0;
+  }
+
+  return 1;
+}
+
+static int CheckAll(unsigned char *pBuf) {
+  size_t cb, off;
+  int i;
+
+  for (cb = 0; cb <= 1024; cb++)
+    for (off = 0; off < 16; off++)
+      if (!Check(pBuf + off, cb, 0) || !Check(pBuf + off, cb, Random()))
+        return 0;
+
+  for (i = 0; i < 2000; i++) {
+    off = Random() % 64;
+    cb = (Random() << 15 | Random()) % (CHECK_SIZE - off);
+    if (!Check(pBuf + off, cb, Random() << 17 ^ Random()))
+      return 0;
+  }
+
+  // All zeros and all ones are the classic ways to get folding wrong
+  memset(pBuf, 0, 4096);
+  if (!Check(pBuf, 4096, 0) || !Check(pBuf, 4096, 0xffffffffUL))
+    return 0;
+  memset(pBuf, 0xff, 4096);
+  if (!Check(pBuf, 4096, 0) || !Check(pBuf, 4096, 0xffffffffUL))
+    return 0;
+
+  return 1;
+}
+
+// Keeps the timed CRCs from being optimized away
+static volatile uLong crcSink;
+
+static void Time(const char *pszName,
+                 uLong (*pfn)(uLong, const unsigned char *, size_t),
+                 const unsigned char *pBuf, size_t cbBuf, size_t cbBlock) {
+  size_t cbDone = 0, off;
+  clock_t start = clock(), elapsed;
+  uLong crc = 0;
+
+  do {
+    for (off = 0; off + cbBlock <= cbBuf; off += cbBlock)
+      crc = pfn(crc, pBuf + off, cbBlock);
+    cbDone += off;
+  } while ((elapsed = clock() - start) < CLOCKS_PER_SEC / 2);
+
+  crcSink = crc;
+
+  printf("%-10s %8lu bytes: %8.1f MB/s\n", pszName, (unsigned long)cbBlock,
+         cbDone / (1024.0 * 1024.0) / ((double)elapsed / CLOCKS_PER_SEC));
+}
+
+static uLong KernelCrc(uLong crc, const unsigned char *p, size_t cb) {
+  return Crc32(crc, p, cb);
+}
+
+int main(int argc, char **argv) {
+  static const size_t acbBlock[] = {64, 4096, 1024 * 1024};
+  unsigned char *pBuf;
+  size_t cbBuf = 64 * 1024 * 1024, i;
+  int bCheckOnly = 0, iArg;
+
+  for (iArg = 1; iArg < argc; iArg++) {
+    if (!strcmp(argv[iArg], "-c"))
+      bCheckOnly = 1;
+    else if (!(cbBuf = strtoul(argv[iArg], NULL, 10) * 1024 * 1024)) {
+      fprintf(stderr, "Usage: %s [-c] [MB]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (cbBuf < CHECK_SIZE)
+    cbBuf = CHECK_SIZE;
+
+  Crc32Init();
+
+  if (!(pBuf = malloc(cbBuf))) {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < cbBuf; i++)
+    pBuf[i] = (unsigned char)Random();
+
+  if (!CheckAll(pBuf)) {
+    free(pBuf);
+    return EXIT_FAILURE;
+  }
+  printf("%s kernel matches zlib\n", Crc32Kernel());
+
+  if (!bCheckOnly) {
+    for (i = 0; i < cbBuf; i++)
+      pBuf[i] = (unsigned char)Random();
+    for (i = 0; i < sizeof(acbBlock) / sizeof(acbBlock[0]); i++) {
+      if (acbBlock[i] > cbBuf)
+        break;
+      Time("zlib", ZlibCrc, pBuf, cbBuf, acbBlock[i]);
+      Time(Crc32Kernel(), KernelCrc, pBuf, cbBuf, acbBlock[i]);
+    }
+  }
+
+  free(pBuf);
+  return EXIT_SUCCESS;
+}
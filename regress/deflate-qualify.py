@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+
+# Check that a trrntzip built against another zlib writes exactly the same
+# zips as the reference build, and how much faster it is.
+#
+# Both binaries rezip a generated corpus (and any zips or directories
+# given) into separate trees, which must match byte for byte. Exits with
+# 1 if anything differs.
+
+import argparse
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import zipfile
+
+from corpus import KINDS, SIZES
+
+
+def make_corpus(directory, megabytes, seed):
+    rnd = random.Random(seed)
+    budget = megabytes * 1024 * 1024
+    count = 0
+    while budget > 0:
+        count += 1
+        path = os.path.join(directory, 'corpus%03d.zip' % count)
+        # stored members get deflated, deflated ones inflated first
+        method = zipfile.ZIP_STORED if count % 3 else zipfile.ZIP_DEFLATED
+        with zipfile.ZipFile(path, 'w', method) as z:
+            for member in range(rnd.randrange(1, 20)):
+                if rnd.random() < 0.3:
+                    size = rnd.choice(SIZES)
+                else:
+                    size = int(rnd.expovariate(1 / (256 * 1024)))
+                size = min(size, max(budget, 0))
+                kind = rnd.choice(KINDS)
+                z.writestr('%s/%04d.bin' % (kind.__name__, member),
+                           kind(rnd, size))
+                budget -= size
+    return count
+
+
+def rezip(binary, inputs, outdir):
+    # -o keeps the paths below each input, so each gets its own tree
+    start = time.perf_counter()
+    for i, path in enumerate(inputs):
+        subprocess.run([binary, '-g', '-f', '-l', '-e', '-j1',
+                        '-o' + os.path.join(outdir, str(i)), path],
+                       cwd=os.path.dirname(path), check=True,
+                       stdout=subprocess.DEVNULL)
+    return time.perf_counter() - start
+
+
+def tree(directory):
+    return {os.path.relpath(os.path.join(root, name), directory)
+            for root, dirs, files in os.walk(directory) for name in files}
+
+
+def compare(refdir, candir):
+    ref = tree(refdir)
+    can = tree(candir)
+    differ = [path + ' (missing)' for path in sorted(ref - can)]
+    differ += [path + ' (extra)' for path in sorted(can - ref)]
+    for path in sorted(ref & can):
+        with open(os.path.join(refdir, path), 'rb') as f, \
+                open(os.path.join(candir, path), 'rb') as g:
+            if f.read() != g.read():
+                differ.append(path)
+    return len(ref | can), differ
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Qualify a trrntzip built against another zlib.')
+    parser.add_argument('reference', help='trrntzip linked with stock zlib')
+    parser.add_argument('candidate', help='trrntzip linked with another zlib')
+    parser.add_argument('inputs', nargs='*',
+                        help='more zips or directories of zips to check')
+    parser.add_argument('-s', '--size', type=int, default=64,
+                        help='MB of generated corpus (default: 64, 0 for none)')
+    parser.add_argument('--seed', type=int, default=1,
+                        help='seed for the generated corpus')
+    parser.add_argument('-k', '--keep', action='store_true',
+                        help='keep the work directory')
+    args = parser.parse_intermixed_args()
+
+    work = tempfile.mkdtemp(prefix='deflate-qualify.')
+    try:
+        inputs = [os.path.abspath(path) for path in args.inputs]
+        if args.size:
+            corpus = os.path.join(work, 'corpus')
+            os.mkdir(corpus)
+            count = make_corpus(corpus, args.size, args.seed)
+            print('generated %d zips, %d MB' % (count, args.size))
+            inputs.append(corpus)
+        if not inputs:
+            parser.error('nothing to check')
+
+        refdir = os.path.join(work, 'reference')
+        candir = os.path.join(work, 'candidate')
+        reftime = rezip(os.path.abspath(args.reference), inputs, refdir)
+        cantime = rezip(os.path.abspath(args.candidate), inputs, candir)
+
+        count, differ = compare(refdir, candir)
+        print('reference: %.2fs' % reftime)
+        print('candidate: %.2fs' % cantime)
+        print('speedup:   %.2fx' % (reftime / cantime if cantime else 0))
+        if differ or not count:
+            for path in differ:
+                print('differs: ' + path)
+            print('FAILED: %d of %d zips differ' % (len(differ), count))
+            return 1
+        print('all %d zips identical' % count)
+        return 0
+    finally:
+        if args.keep:
+            print('work directory: ' + work)
+        else:
+            shutil.rmtree(work)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
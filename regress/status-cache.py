@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+
+# Check the status cache of -k: archives it lists are skipped without
+# being opened, -r checks them anyway, changed archives are checked again
+# and what was found with -d is kept apart. Showing that an archive is
+# not opened takes changing it behind the cache's back, hence a script.
+#
+# Exits with 77 (skipped) where the cache doesn't key archives by inode.
+
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+HEADER = struct.Struct('=8sIIQ')
+ENTRY = struct.Struct('=QQQII')
+
+SKIPPED = 'Skipping, already TorrentZipped - %s'
+REZIPPED = 'Rezipping - %s'
+
+MASK = (1 << 64) - 1
+
+
+def mix(x):
+    x ^= x >> 30
+    x = x * 0xbf58476d1ce4e5b9 & MASK
+    x ^= x >> 27
+    x = x * 0x94d049bb133111eb & MASK
+    x ^= x >> 31
+    return x
+
+
+def stamp(st, nsec):
+    # Stamp() in statuscache.c, with or without nanoseconds
+    value = mix(st.st_size)
+    for ns in [st.st_mtime_ns, st.st_ctime_ns]:
+        value = mix(value ^ (ns // 10**9 & MASK))
+        value = mix(value ^ (ns % 10**9 if nsec else 0))
+    return value
+
+
+def find(data, st):
+    # Offset of the entry for st in the cache file data, or None
+    for offset in range(HEADER.size, len(data), ENTRY.size):
+        if ENTRY.unpack_from(data, offset)[:2] == (st.st_dev, st.st_ino):
+            return offset
+    return None
+
+
+def calibrate(cache, path):
+    # Find out whether the stamps have nanoseconds, None if path isn't
+    # listed as expected
+    with open(cache, 'rb') as f:
+        data = f.read()
+    st = os.stat(path)
+    offset = find(data, st)
+    if offset is not None:
+        for nsec in [True, False]:
+            if ENTRY.unpack_from(data, offset)[2] == stamp(st, nsec):
+                return nsec
+    return None
+
+
+def restamp(cache, path, nsec):
+    # Make the entry for path match it again, as if it had been changed
+    # without its size and times showing it. Returns whether it's listed.
+    with open(cache, 'rb') as f:
+        data = bytearray(f.read())
+    st = os.stat(path)
+    offset = find(data, st)
+    if offset is None:
+        return False
+    dev, ino, value, crc, flags = ENTRY.unpack_from(data, offset)
+    ENTRY.pack_into(data, offset, dev, ino, stamp(st, nsec), crc, flags)
+    with open(cache, 'wb') as f:
+        f.write(data)
+    return True
+
+
+def modify(path, data):
+    # Flip a byte of the member data and one of the central directory
+    # checksum in the comment, so checking finds the archive needs
+    # rezipping and rezipping finds the member broken
+    data = bytearray(data)
+    data[40] ^= 0xff
+    data[-1] = ord('0') if data[-1] != ord('0') else ord('1')
+    with open(path, 'wb') as f:
+        f.write(data)
+
+
+def main():
+    trrntzip = os.path.abspath(sys.argv[1])
+    srcdir = os.path.dirname(os.path.abspath(__file__))
+    with open(os.path.join(srcdir, 'small.tzip'), 'rb') as f:
+        small = f.read()
+    with open(os.path.join(srcdir, 'directories.tzip'), 'rb') as f:
+        directories = f.read()
+
+    work = tempfile.mkdtemp(prefix='status-cache.')
+    failed = []
+
+    def run(args, expected, stderr=None):
+        proc = subprocess.run([trrntzip, '-g', '-l', '-e', '-kcache'] + args,
+                              cwd=work, stdout=subprocess.PIPE,
+                              stderr=subprocess.PIPE,
+                              universal_newlines=True)
+        lines = proc.stdout.splitlines()
+        if (proc.returncode != 0 or expected not in lines or
+                (stderr is None and proc.stderr) or
+                (stderr is not None and stderr not in proc.stderr)):
+            failed.append('%s: expected "%s", exit code %d, stdout:\n%s'
+                          'stderr:\n%s' % (' '.join(args), expected,
+                                            proc.returncode, proc.stdout,
+                                            proc.stderr))
+
+    try:
+        for name, data in [('broken.zip', small), ('touched.zip', small),
+                           ('dirs.zip', directories)]:
+            with open(os.path.join(work, name), 'wb') as f:
+                f.write(data)
+
+        run(['broken.zip', 'touched.zip'], SKIPPED % 'broken.zip')
+        cache = os.path.join(work, 'cache')
+        broken = os.path.join(work, 'broken.zip')
+        nsec = calibrate(cache, broken)
+        if nsec is None:
+            print('cache has no entry matching broken.zip')
+            return 77
+
+        # Listed archives aren't opened, -r looks at them anyway
+        modify(broken, small)
+        if not restamp(cache, broken, nsec):
+            failed.append('broken.zip dropped from the cache')
+        run(['broken.zip'], SKIPPED % 'broken.zip')
+        run(['-r', 'broken.zip'], REZIPPED % 'broken.zip',
+            'CRC error in "test.txt" in "broken.zip"!')
+
+        # An archive written since is checked again
+        modify(os.path.join(work, 'touched.zip'), small)
+        run(['touched.zip'], REZIPPED % 'touched.zip',
+            'CRC error in "test.txt" in "touched.zip"!')
+
+        # Not having to strip sub-directories says nothing about -d
+        run(['dirs.zip'], SKIPPED % 'dirs.zip')
+        run(['-d', 'dirs.zip'], REZIPPED % 'dirs.zip')
+        run(['-d', 'dirs.zip'], SKIPPED % 'dirs.zip')
+        run(['dirs.zip'], SKIPPED % 'dirs.zip')
+
+        if failed:
+            print('\n'.join(failed))
+            return 1
+        return 0
+    finally:
+        shutil.rmtree(work)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+
+# Check the stream cache of -z: a member two archives share is stored
+# once, under the name derived from its CRC, size and SHA-256, and both
+# archives come out as without the cache. A damaged stream in the cache
+# is not used. nihtest can't name files after a digest, hence a script.
+
+import hashlib
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import zipfile
+import zlib
+
+DATE = (1996, 12, 24, 23, 32, 0)
+
+# At least STREAMCACHE_MIN_SIZE, so the cache keeps it
+SHARED_SIZE = 64 * 1024
+
+
+def add(z, name, data):
+    info = zipfile.ZipInfo(name, DATE)
+    info.compress_type = zipfile.ZIP_DEFLATED
+    z.writestr(info, data)
+
+
+def run(trrntzip, args, cwd):
+    proc = subprocess.run([trrntzip, '-g', '-l', '-e'] + args, cwd=cwd,
+                          stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                          universal_newlines=True)
+    if proc.returncode != 0 or proc.stderr:
+        return ['%s: exit code %d, stderr:\n%s' %
+                (' '.join(args), proc.returncode, proc.stderr)]
+    return []
+
+
+def read(path):
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+def main():
+    trrntzip = os.path.abspath(sys.argv[1])
+    rnd = random.Random(1)
+    words = [bytes(rnd.choice(b'abcdefghijklmnop')
+                   for _ in range(rnd.randrange(2, 9))) for _ in range(500)]
+    shared = b' '.join(rnd.choice(words)
+                       for _ in range(SHARED_SIZE))[:SHARED_SIZE]
+    name = '%08x-%016x-%s.tzd' % (zlib.crc32(shared), len(shared),
+                                  hashlib.sha256(shared).hexdigest())
+
+    work = tempfile.mkdtemp(prefix='stream-cache.')
+    try:
+        for directory in ['src', 'expected', 'cached']:
+            os.makedirs(os.path.join(work, directory))
+        for archive in ['a.zip', 'b.zip']:
+            with zipfile.ZipFile(os.path.join(work, 'src', archive),
+                                 'w') as z:
+                add(z, 'shared.txt', shared)
+                add(z, archive + '.txt', archive.encode() * 100)
+            shutil.copy(os.path.join(work, 'src', archive),
+                        os.path.join(work, 'expected'))
+
+        failed = run(trrntzip, ['expected'], work)
+        good = None
+
+        # Both archives through the cache, then again with a damaged stream
+        for step in ['shared', 'damaged']:
+            for archive in ['a.zip', 'b.zip']:
+                shutil.copy(os.path.join(work, 'src', archive),
+                            os.path.join(work, 'cached'))
+            failed += run(trrntzip, ['-zcache', 'cached'], work)
+
+            streams = sorted(os.listdir(os.path.join(work, 'cache')))
+            if streams != [name]:
+                failed.append('%s: cache has %s instead of %s' %
+                              (step, streams, name))
+            for archive in ['a.zip', 'b.zip']:
+                if (read(os.path.join(work, 'cached', archive)) !=
+                        read(os.path.join(work, 'expected', archive))):
+                    failed.append('%s: %s differs from the one rezipped '
+                                  'without -z' % (step, archive))
+
+            if step == 'shared' and streams == [name]:
+                stream = os.path.join(work, 'cache', name)
+                good = read(stream)
+                damaged = bytearray(good)
+                damaged[len(damaged) // 2] ^= 0xff
+                with open(stream, 'wb') as f:
+                    f.write(damaged)
+
+        # The damaged stream was dropped and stored again
+        stream = os.path.join(work, 'cache', name)
+        if good and os.path.exists(stream) and read(stream) != good:
+            failed.append('damaged stream was kept')
+
+        if failed:
+            print('\n'.join(failed))
+            return 1
+        return 0
+    finally:
+        shutil.rmtree(work)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+
+# Check how the directory walker treats symlinks: a symlinked directory
+# given on the command line is followed, symlinks found while walking
+# are not. nihtest can't create symlinks, hence a script.
+#
+# Exits with 77 (skipped) where symlinks can't be created.
+
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+
+def main():
+    trrntzip = os.path.abspath(sys.argv[1])
+    srcdir = os.path.dirname(os.path.abspath(__file__))
+    with open(os.path.join(srcdir, 'small.zip'), 'rb') as f:
+        small = f.read()
+    with open(os.path.join(srcdir, 'small.tzip'), 'rb') as f:
+        tzip = f.read()
+
+    work = tempfile.mkdtemp(prefix='walk-symlinks.')
+    try:
+        os.makedirs(os.path.join(work, 'dir'))
+        os.makedirs(os.path.join(work, 'other'))
+        for path in ['dir/a.zip', 'other/b.zip']:
+            with open(os.path.join(work, path), 'wb') as f:
+                f.write(small)
+        try:
+            os.symlink('dir', os.path.join(work, 'link'),
+                       target_is_directory=True)
+            os.symlink(os.path.join('..', 'other'),
+                       os.path.join(work, 'dir', 'inner'),
+                       target_is_directory=True)
+        except (OSError, NotImplementedError) as e:
+            print('cannot create symlinks: %s' % e)
+            return 77
+
+        proc = subprocess.run([trrntzip, '-g', '-l', '-e', 'link'], cwd=work,
+                              stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                              universal_newlines=True)
+        failed = []
+        if proc.returncode != 0 or proc.stderr:
+            failed.append('exit code %d, stderr:\n%s' %
+                          (proc.returncode, proc.stderr))
+        with open(os.path.join(work, 'dir', 'a.zip'), 'rb') as f:
+            if f.read() != tzip:
+                failed.append('link/a.zip was not rezipped')
+        with open(os.path.join(work, 'other', 'b.zip'), 'rb') as f:
+            if f.read() != small:
+                failed.append('link/inner/b.zip was rezipped through a '
+                              'symlink found while walking')
+        if failed:
+            print('\n'.join(failed))
+            print('stdout:\n' + proc.stdout)
+            return 1
+        return 0
+    finally:
+        shutil.rmtree(work)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
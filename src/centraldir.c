@@ -0,0 +1,247 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "centraldir.h"
+#include "crc32.h"
+
+// minizip's unzOpen finds the end of central directory record with many
+// small reads from the end of the file, and reads every central header
+// field by field. Here the end of the file is read once and the central
+// directory is loaded (or used in place if the file is mapped) in one
+// piece, which also makes its CRC a single pass. The end records are
+// checked like minizip does, so the same archives are accepted.
+
+#define END_SIZE 22           // end of central directory record
+#define ZIP64_LOCATOR_SIZE 20 // zip64 end of central directory locator
+#define ZIP64_END_SIZE 56     // zip64 end of central directory record
+#define CENTRAL_HEADER_SIZE 46
+#define MAX_TAIL 0xffff // how far back minizip looks for the end records
+
+static uLong Get16(const unsigned char *p) {
+  return (uLong)p[0] | (uLong)p[1] << 8;
+}
+
+static uLong Get32(const unsigned char *p) {
+  return Get16(p) | Get16(p + 2) << 16;
+}
+
+static ZPOS64_T Get64(const unsigned char *p) {
+  return (ZPOS64_T)Get32(p) | (ZPOS64_T)Get32(p + 4) << 32;
+}
+
+// Point *pp to cb bytes at pos, in place if the file is mapped or else
+// read into a new *ppBuffer
+static int Load(MAPFILE *mf, ZPOS64_T pos, size_t cb,
+                const unsigned char **pp, unsigned char **ppBuffer) {
+  const unsigned char *pMap = MapFileData(mf);
+
+  *ppBuffer = NULL;
+  if (pMap) {
+    *pp = pMap + pos;
+    return TZ_OK;
+  }
+
+  if (!(*ppBuffer = malloc(cb ? cb : 1)))
+    return TZ_CRITICAL;
+  if (MapFileRead(mf, pos, *ppBuffer, cb)) {
+    free(*ppBuffer);
+    *ppBuffer = NULL;
+    return TZ_ERR;
+  }
+  *pp = *ppBuffer;
+
+  return TZ_OK;
+}
+
+// Offset of the last signature sig in the tail, or -1
+static long FindLast(const unsigned char *pTail, size_t cbTail,
+                     const char *sig) {
+  size_t i;
+
+  if (cbTail < 4)
+    return -1;
+
+  for (i = cbTail - 3; i-- > 0;)
+    if (!memcmp(pTail + i, sig, 4))
+      return (long)i;
+
+  return -1;
+}
+
+// Read the zip64 end of central directory record, if the locator in the
+// tail points to one. Returns 1 if it doesn't, so it's a plain zip.
+static int ReadZip64End(MAPFILE *mf, const unsigned char *pTail,
+                        size_t cbTail, ZPOS64_T *pposEnd, ZPOS64_T *pcbDir,
+                        CENTRALDIR *cd) {
+  unsigned char Record[ZIP64_END_SIZE];
+  long iLocator = FindLast(pTail, cbTail, "PK\6\7");
+  const unsigned char *p;
+
+  if (iLocator < 0 || cbTail - iLocator < ZIP64_LOCATOR_SIZE)
+    return 1;
+  p = pTail + iLocator;
+
+  // On disk 0 out of 1
+  if (Get32(p + 4) != 0 || Get32(p + 16) != 1)
+    return 1;
+
+  *pposEnd = Get64(p + 8);
+  if (MapFileRead(mf, *pposEnd, Record, 4) || memcmp(Record, "PK\6\6", 4))
+    return 1;
+
+  // Disk numbers, and entries on this disk and in total
+  if (MapFileRead(mf, *pposEnd, Record, ZIP64_END_SIZE) ||
+      Get32(Record + 16) != 0 || Get32(Record + 20) != 0 ||
+      Get64(Record + 24) != Get64(Record + 32))
+    return TZ_ERR;
+
+  cd->cEntries = Get64(Record + 32);
+  *pcbDir = Get64(Record + 40);
+  cd->offCentralDir = Get64(Record + 48);
+
+  return TZ_OK;
+}
+
+static int ReadEnd(const unsigned char *pTail, size_t cbTail,
+                   ZPOS64_T posTail, ZPOS64_T *pposEnd, ZPOS64_T *pcbDir,
+                   CENTRALDIR *cd) {
+  long iEnd = FindLast(pTail, cbTail, "PK\5\6");
+  const unsigned char *p;
+
+  if (iEnd < 0 || cbTail - iEnd < END_SIZE)
+    return TZ_ERR;
+  p = pTail + iEnd;
+
+  // Disk numbers, and entries on this disk and in total
+  if (Get16(p + 4) != 0 || Get16(p + 6) != 0 || Get16(p + 8) != Get16(p + 10))
+    return TZ_ERR;
+
+  *pposEnd = posTail + iEnd;
+  cd->cEntries = Get16(p + 10);
+  *pcbDir = Get32(p + 12);
+  cd->offCentralDir = Get32(p + 16);
+
+  return TZ_OK;
+}
+
+// Find and load the central directory of the zip in mf. Returns TZ_ERR if
+// it's not a zip minizip could open, TZ_CRITICAL if memory runs out.
+int CentralDirRead(MAPFILE *mf, CENTRALDIR *cd) {
+  ZPOS64_T cbFile = MapFileSize(mf);
+  size_t cbTail = cbFile < MAX_TAIL ? (size_t)cbFile : MAX_TAIL;
+  ZPOS64_T posTail = cbFile - cbTail;
+  ZPOS64_T posEnd = 0, cbDir = 0;
+  const unsigned char *pTail = NULL;
+  unsigned char *pTailBuffer;
+  int rc;
+
+  memset(cd, 0, sizeof(CENTRALDIR));
+
+  if ((rc = Load(mf, posTail, cbTail, &pTail, &pTailBuffer)) != TZ_OK)
+    return rc;
+
+  rc = ReadZip64End(mf, pTail, cbTail, &posEnd, &cbDir, cd);
+  if (rc == 1)
+    rc = ReadEnd(pTail, cbTail, posTail, &posEnd, &cbDir, cd);
+  free(pTailBuffer);
+  if (rc != TZ_OK)
+    return rc;
+
+  // The central directory ends where the end records start. Anything
+  // before the zip shifts it from where the zip says it is.
+  if (cd->offCentralDir > posEnd || cbDir > posEnd - cd->offCentralDir ||
+      cbDir != (size_t)cbDir)
+    return TZ_ERR;
+
+  cd->posCentralDir = posEnd - cbDir;
+  cd->cbCentralDir = (size_t)cbDir;
+  if ((rc = Load(mf, cd->posCentralDir, cd->cbCentralDir, &cd->pData,
+                 &cd->pBuffer)) != TZ_OK)
+    return rc;
+
+  cd->crc = Crc32(0L, cd->pData, cd->cbCentralDir);
+
+  return TZ_OK;
+}
+
+// Parse the entry at *poff and move *poff to the next one. Returns TZ_ERR
+// if the entry is broken or sticks out of the central directory.
+int CentralDirEntry(const CENTRALDIR *cd, size_t *poff, CENTRALDIRENTRY *e) {
+  const unsigned char *p = cd->pData + *poff;
+  const unsigned char *pExtra, *pField;
+  size_t cbLeft = cd->cbCentralDir - *poff;
+  size_t cbEntry, cbExtra, cbField;
+
+  if (cbLeft < CENTRAL_HEADER_SIZE || memcmp(p, "PK\1\2", 4))
+    return TZ_ERR;
+
+  e->cchName = Get16(p + 28);
+  cbExtra = Get16(p + 30);
+  cbEntry = CENTRAL_HEADER_SIZE + e->cchName + cbExtra + Get16(p + 32);
+  if (cbLeft < cbEntry)
+    return TZ_ERR;
+
+  e->pName = (const char *)p + CENTRAL_HEADER_SIZE;
+  e->iMethod = (int)Get16(p + 10);
+  e->crc = Get32(p + 16);
+  e->cCompressed = Get32(p + 20);
+  e->cUncompressed = Get32(p + 24);
+  e->offLocalHeader = Get32(p + 42);
+  e->offEntry = *poff;
+
+  // Values too big for the header are in the zip64 extra field, in this
+  // order
+  pExtra = p + CENTRAL_HEADER_SIZE + e->cchName;
+  for (; cbExtra >= 4; cbExtra -= 4 + cbField, pExtra += 4 + cbField) {
+    cbField = Get16(pExtra + 2);
+    if (cbField > cbExtra - 4)
+      break;
+    if (Get16(pExtra) != 0x0001)
+      continue;
+
+    pField = pExtra + 4;
+    if (e->cUncompressed == 0xffffffff) {
+      if (pField + 8 > pExtra + 4 + cbField)
+        return TZ_ERR;
+      e->cUncompressed = Get64(pField);
+      pField += 8;
+    }
+    if (e->cCompressed == 0xffffffff) {
+      if (pField + 8 > pExtra + 4 + cbField)
+        return TZ_ERR;
+      e->cCompressed = Get64(pField);
+      pField += 8;
+    }
+    if (e->offLocalHeader == 0xffffffff) {
+      if (pField + 8 > pExtra + 4 + cbField)
+        return TZ_ERR;
+      e->offLocalHeader = Get64(pField);
+    }
+  }
+
+  *poff += cbEntry;
+
+  return TZ_OK;
+}
+
+void CentralDirFree(CENTRALDIR *cd) {
+  free(cd->pBuffer);
+  cd->pBuffer = NULL;
+  cd->pData = NULL;
+}
@@ -0,0 +1,51 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef CENTRALDIR_DOT_H
+#define CENTRALDIR_DOT_H
+
+#include "global.h"
+#include "mapfile.h"
+
+// The central directory of a zip, read in one go. Members are found by
+// walking it with CentralDirEntry, without minizip.
+typedef struct _CENTRALDIR {
+  ZPOS64_T posCentralDir; // where it starts in the file
+  ZPOS64_T offCentralDir; // where the zip says it starts
+  ZPOS64_T cEntries;
+  size_t cbCentralDir;
+  uLong crc; // of the whole central directory
+  const unsigned char *pData;
+  unsigned char *pBuffer; // pData unless the file is mapped
+} CENTRALDIR;
+
+// A member as listed in the central directory. The name isn't terminated.
+typedef struct _CENTRALDIRENTRY {
+  const char *pName;
+  size_t cchName;
+  int iMethod;
+  uLong crc;
+  ZPOS64_T cCompressed;
+  ZPOS64_T cUncompressed;
+  ZPOS64_T offLocalHeader;
+  size_t offEntry; // of the entry, from the start of the central directory
+} CENTRALDIRENTRY;
+
+int CentralDirRead(MAPFILE *mf, CENTRALDIR *cd);
+int CentralDirEntry(const CENTRALDIR *cd, size_t *poff, CENTRALDIRENTRY *e);
+void CentralDirFree(CENTRALDIR *cd);
+
+#endif
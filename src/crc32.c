@@ -0,0 +1,194 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "crc32.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CRC32_CLMUL
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__AARCH64EL__) && defined(__GNUC__) && \
+    (defined(__ARM_FEATURE_CRC32) || defined(HAVE_GETAUXVAL))
+#define CRC32_ARM
+#ifdef HAVE_GETAUXVAL
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+#ifdef __clang__
+// arm_acle.h hides the intrinsics unless the whole file targets +crc
+#define TARGET_CRC __attribute__((target("crc")))
+#define __crc32b __builtin_arm_crc32b
+#define __crc32d __builtin_arm_crc32d
+#else
+#define TARGET_CRC __attribute__((target("+crc")))
+#pragma GCC push_options
+#pragma GCC target("+crc")
+#include <arm_acle.h>
+#pragma GCC pop_options
+#endif
+#endif
+
+typedef uLong (*CRC32KERNEL)(uLong crc, const unsigned char *p, size_t cb);
+
+// zlib's crc32() takes at most a uInt at a time
+static uLong Crc32Zlib(uLong crc, const unsigned char *p, size_t cb) {
+  uInt len;
+
+  for (; cb > 0; p += len, cb -= len) {
+    len = cb < 0x40000000 ? (uInt)cb : 0x40000000;
+    crc = crc32(crc, p, len);
+  }
+
+  return crc;
+}
+
+#ifdef CRC32_CLMUL
+// Fold 64 bytes at a time with carry-less multiplication, then reduce to
+// 32 bits, from Intel's "Fast CRC Computation for Generic Polynomials Using
+// PCLMULQDQ Instruction". cb must be a multiple of 16 and at least 64, crc
+// is not inverted.
+__attribute__((target("sse2,pclmul"))) static uint32_t
+FoldClmul(uint32_t crc, const unsigned char *p, size_t cb) {
+  __m128i k, x1, x2, x3, x4, y1, y2, y3, y4;
+  const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+  x1 = _mm_loadu_si128((const __m128i *)p);
+  x2 = _mm_loadu_si128((const __m128i *)(p + 16));
+  x3 = _mm_loadu_si128((const __m128i *)(p + 32));
+  x4 = _mm_loadu_si128((const __m128i *)(p + 48));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+  p += 64;
+  cb -= 64;
+
+  // x^(4*128+64), x^(4*128)
+  k = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  for (; cb >= 64; p += 64, cb -= 64) {
+    y1 = _mm_clmulepi64_si128(x1, k, 0x00);
+    y2 = _mm_clmulepi64_si128(x2, k, 0x00);
+    y3 = _mm_clmulepi64_si128(x3, k, 0x00);
+    y4 = _mm_clmulepi64_si128(x4, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, y1),
+                       _mm_loadu_si128((const __m128i *)p));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, y2),
+                       _mm_loadu_si128((const __m128i *)(p + 16)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, y3),
+                       _mm_loadu_si128((const __m128i *)(p + 32)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, y4),
+                       _mm_loadu_si128((const __m128i *)(p + 48)));
+  }
+
+  // x^(128+64), x^128: fold the four into one, then the rest 16 at a time
+  k = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  y1 = _mm_clmulepi64_si128(x1, k, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), x2);
+  y1 = _mm_clmulepi64_si128(x1, k, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), x3);
+  y1 = _mm_clmulepi64_si128(x1, k, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, y1), x4);
+  for (; cb >= 16; p += 16, cb -= 16) {
+    y1 = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, y1),
+                       _mm_loadu_si128((const __m128i *)p));
+  }
+
+  // 128 bits to 64
+  y1 = _mm_clmulepi64_si128(x1, k, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), y1);
+  k = _mm_set_epi64x(0, 0x0163cd6124); // x^64
+  y1 = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00);
+  x1 = _mm_xor_si128(x1, y1);
+
+  // Barrett reduction to 32 bits with P(x) and mu
+  k = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  y1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+  y1 = _mm_clmulepi64_si128(_mm_and_si128(y1, mask), k, 0x00);
+  x1 = _mm_xor_si128(x1, y1);
+
+  return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+static uLong Crc32Clmul(uLong crc, const unsigned char *p, size_t cb) {
+  size_t cbFold = cb < 64 ? 0 : cb & ~(size_t)15;
+
+  if (cbFold)
+    crc = ~FoldClmul(~(uint32_t)crc, p, cbFold) & 0xffffffffUL;
+
+  return Crc32Zlib(crc, p + cbFold, cb - cbFold);
+}
+#endif
+
+#ifdef CRC32_ARM
+TARGET_CRC static uLong Crc32Arm(uLong crc, const unsigned char *p,
+                                 size_t cb) {
+  uint32_t c = ~(uint32_t)crc;
+  uint64_t v;
+
+  for (; cb > 0 && ((uintptr_t)p & 7); cb--)
+    c = __crc32b(c, *p++);
+  for (; cb >= 8; p += 8, cb -= 8) {
+    memcpy(&v, p, 8);
+    c = __crc32d(c, v);
+  }
+  for (; cb > 0; cb--)
+    c = __crc32b(c, *p++);
+
+  return ~c & 0xffffffffUL;
+}
+#endif
+
+static CRC32KERNEL Kernel = Crc32Zlib;
+static const char *pszKernel = "zlib";
+
+void Crc32Init(void) {
+#ifdef CRC32_CLMUL
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2") && __builtin_cpu_supports("pclmul")) {
+    Kernel = Crc32Clmul;
+    pszKernel = "pclmul";
+  }
+#endif
+#ifdef CRC32_ARM
+#ifndef __ARM_FEATURE_CRC32
+  if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+#endif
+  {
+    Kernel = Crc32Arm;
+    pszKernel = "armv8-crc";
+  }
+#endif
+}
+
+uLong Crc32(uLong crc, const void *pData, size_t cbData) {
+  return Kernel(crc, pData, cbData);
+}
+
+const char *Crc32Kernel(void) { return pszKernel; }
@@ -0,0 +1,34 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef CRC32_DOT_H
+#define CRC32_DOT_H
+
+#include <stddef.h>
+
+#include "zlib.h"
+
+// CRC-32 as zlib's crc32() computes it, but for any length and with the
+// carry-less multiply (x86) or CRC32 (ARMv8) instructions when the CPU has
+// them. Crc32Init picks the kernel; call it once before starting threads.
+// Until then, and on other CPUs, zlib's crc32() is used.
+void Crc32Init(void);
+uLong Crc32(uLong crc, const void *pData, size_t cbData);
+
+// Name of the kernel Crc32 uses, for benchmarks
+const char *Crc32Kernel(void);
+
+#endif
@@ -0,0 +1,189 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+
+#include <stdlib.h>
+
+#include "crc32.h"
+#include "decoder.h"
+
+#define LOCAL_HEADER_SIZE 30
+
+struct _DECODER {
+  z_stream zs;              // reset for each member inflated
+  unsigned char *pBuf;      // DECODER_CHUNK bytes of output
+  unzFile UnZipHandle;      // reading through minizip, unless NULL
+  const unsigned char *pIn; // compressed data not given to zs yet
+  ZPOS64_T cbIn;
+  ZPOS64_T cLeft; // bytes still to be read
+  int bInflate;
+  int bRaw;
+  uLong crc;
+  uLong crcExpected;
+};
+
+static uLong Get16(const unsigned char *p) {
+  return (uLong)p[0] | (uLong)p[1] << 8;
+}
+
+static uLong Get32(const unsigned char *p) {
+  return Get16(p) | Get16(p + 2) << 16;
+}
+
+// The data of e in the mapped zip, or NULL unless its local header matches
+// the central directory the way unzOpenCurrentFile wants it to
+static const unsigned char *FindData(const MAPFILE *mf, const ZIPENTRY *e) {
+  const unsigned char *pMap = MapFileData(mf), *p;
+  ZPOS64_T cbMap = MapFileSize(mf), pos = e->posLocalHeader;
+
+  if (pMap == NULL || (e->iMethod != 0 && e->iMethod != Z_DEFLATED) ||
+      pos > cbMap || cbMap - pos < LOCAL_HEADER_SIZE)
+    return NULL;
+  p = pMap + pos;
+
+  if (Get32(p) != 0x04034b50 || Get16(p + 8) != (uLong)e->iMethod ||
+      Get16(p + 26) != e->cchName)
+    return NULL;
+
+  // CRC and sizes may be left to a data descriptor
+  if (!(Get16(p + 6) & 8) &&
+      (Get32(p + 14) != e->crc ||
+       (Get32(p + 18) != 0xFFFFFFFF && Get32(p + 18) != e->cCompressed) ||
+       (Get32(p + 22) != 0xFFFFFFFF && Get32(p + 22) != e->cUncompressed)))
+    return NULL;
+
+  pos += LOCAL_HEADER_SIZE + Get16(p + 26) + Get16(p + 28);
+  if (pos > cbMap || cbMap - pos < e->cCompressed)
+    return NULL;
+
+  return pMap + pos;
+}
+
+DECODER *DecoderCreate(void) {
+  DECODER *dec = calloc(1, sizeof(DECODER));
+
+  if (dec == NULL)
+    return NULL;
+
+  if (!(dec->pBuf = malloc(DECODER_CHUNK)) ||
+      inflateInit2(&dec->zs, -MAX_WBITS) != Z_OK) {
+    free(dec->pBuf);
+    free(dec);
+    return NULL;
+  }
+
+  return dec;
+}
+
+// Open e, which UnZipHandle must be positioned at
+int DecoderOpen(DECODER *dec, unzFile UnZipHandle, const MAPFILE *mf,
+                const ZIPENTRY *e, int bRaw) {
+  if (!(dec->pIn = FindData(mf, e))) {
+    dec->UnZipHandle = UnZipHandle;
+    return unzOpenCurrentFile2(UnZipHandle, NULL, NULL, bRaw);
+  }
+
+  dec->UnZipHandle = NULL;
+  dec->cbIn = e->cCompressed;
+  dec->cLeft = bRaw ? e->cCompressed : e->cUncompressed;
+  dec->bInflate = !bRaw && e->iMethod == Z_DEFLATED;
+  dec->bRaw = bRaw;
+  dec->crc = 0;
+  dec->crcExpected = e->crc;
+
+  if (dec->bInflate) {
+    dec->zs.avail_in = 0;
+    if (inflateReset(&dec->zs) != Z_OK)
+      return UNZ_INTERNALERROR;
+  }
+
+  return UNZ_OK;
+}
+
+// Returns the number of bytes at *ppData, 0 at the end or an error < 0.
+// The data is valid until the next call.
+int DecoderRead(DECODER *dec, const void **ppData) {
+  uInt cbOut = dec->cLeft < DECODER_CHUNK ? (uInt)dec->cLeft : DECODER_CHUNK;
+  uInt cbIn;
+  int err;
+
+  if (dec->UnZipHandle) {
+    *ppData = dec->pBuf;
+    return unzReadCurrentFile(dec->UnZipHandle, dec->pBuf, DECODER_CHUNK);
+  }
+
+  if (!dec->bInflate) {
+    // Stored or raw data is passed on from the map, in pieces as big as
+    // the writer takes them without copying
+    cbOut = dec->cLeft < 0x40000000 ? (uInt)dec->cLeft : 0x40000000;
+    if (cbOut > dec->cbIn)
+      cbOut = (uInt)dec->cbIn;
+    *ppData = dec->pIn;
+    dec->pIn += cbOut;
+    dec->cbIn -= cbOut;
+  } else {
+    if (!cbOut)
+      return 0;
+
+    dec->zs.next_out = dec->pBuf;
+    dec->zs.avail_out = cbOut;
+    do {
+      if (dec->zs.avail_in == 0) {
+        cbIn = dec->cbIn < 0x40000000 ? (uInt)dec->cbIn : 0x40000000;
+        dec->zs.next_in = (Bytef *)dec->pIn;
+        dec->zs.avail_in = cbIn;
+        dec->pIn += cbIn;
+        dec->cbIn -= cbIn;
+      }
+      err = inflate(&dec->zs, Z_SYNC_FLUSH);
+      if (err >= 0 && dec->zs.msg != NULL)
+        err = Z_DATA_ERROR;
+    } while (err == Z_OK && dec->zs.avail_out > 0);
+
+    // Like minizip, running out of data before the end of the stream is
+    // an error, too
+    if (err != Z_OK && err != Z_STREAM_END)
+      return err;
+
+    cbOut -= dec->zs.avail_out;
+    *ppData = dec->pBuf;
+  }
+
+  if (!dec->bRaw)
+    dec->crc = Crc32(dec->crc, *ppData, cbOut);
+  dec->cLeft -= cbOut;
+
+  return (int)cbOut;
+}
+
+// UNZ_CRCERROR if all the data was read and the CRC doesn't match
+int DecoderClose(DECODER *dec) {
+  if (dec->UnZipHandle)
+    return unzCloseCurrentFile(dec->UnZipHandle);
+
+  if (!dec->bRaw && dec->cLeft == 0 && dec->crc != dec->crcExpected)
+    return UNZ_CRCERROR;
+
+  return UNZ_OK;
+}
+
+void DecoderFree(DECODER *dec) {
+  if (dec == NULL)
+    return;
+
+  inflateEnd(&dec->zs);
+  free(dec->pBuf);
+  free(dec);
+}
@@ -0,0 +1,41 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef DECODER_DOT_H
+#define DECODER_DOT_H
+
+#include "global.h"
+#include "mapfile.h"
+
+// Inflated output comes in chunks of this size, unless the member is
+// smaller
+#define DECODER_CHUNK (1024 * 1024)
+
+// Reads members' data like unzOpenCurrentFile2, unzReadCurrentFile and
+// unzCloseCurrentFile do, with the same results. Members of a mapped zip
+// are inflated from the map in one go into big chunks, stored and raw ones
+// aren't copied at all. Anything else, or anything that looks wrong, is
+// read through minizip, so it's reported just as before.
+typedef struct _DECODER DECODER;
+
+DECODER *DecoderCreate(void);
+int DecoderOpen(DECODER *dec, unzFile UnZipHandle, const MAPFILE *mf,
+                const ZIPENTRY *e, int bRaw);
+int DecoderRead(DECODER *dec, const void **ppData);
+int DecoderClose(DECODER *dec);
+void DecoderFree(DECODER *dec);
+
+#endif
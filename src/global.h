@@ -16,8 +16,9 @@
 #ifndef GLOBAL_DOT_H
 #define GLOBAL_DOT_H
 
-#include "minizip/zip.h"
+#include "minizip/unzip.h"
 
+#include <stdint.h>
 #include <stdio.h>
 
 #include "platform.h"
@@ -31,24 +32,66 @@
 
 #define MAX_PATH 1024
 
+// Strings stored back to back in one buffer, see StringTable... in util.h
+typedef struct _STRINGTABLE {
+  char *pData;
+  size_t cbUsed;
+  size_t cbAlloc;
+} STRINGTABLE;
+
+// A name with what it's sorted by, see SortNameInit in util.h
+typedef struct _SORTNAME {
+  char *pszName;
+  const char *pszKey; // pszName folded to lower case
+  size_t iBase;       // where the part sorted by first starts
+  uint64_t Prefix;    // its first 8 bytes of key, for quick comparisons
+} SORTNAME;
+
+// A zip member's name (from the Names of the workspace), where to find it
+// and what its central directory entry says about it
+typedef struct _ZIPENTRY {
+  char *pszName; // these must come first, so ZIPENTRY works as SORTNAME
+  const char *pszKey;
+  size_t iBase;
+  uint64_t Prefix;
+  size_t iName; // offset of the name in Names while reading
+  size_t cchName;
+  unz64_file_pos pos;
+  ZPOS64_T posLocalHeader; // in the file, past anything before the zip
+  int iMethod;
+  uLong crc;
+  ZPOS64_T cCompressed;
+  ZPOS64_T cUncompressed;
+} ZIPENTRY;
+
 typedef struct _WORKSPACE {
-  zip_fileinfo zi;
-  char **FileNameArray;
-  int iElements;
+  STRINGTABLE Names;
+  ZIPENTRY *Entries; // followed by one with an empty name
+  int iEntries;
+  int iEntryElements;
   unsigned int iBufSize;
   unsigned char *pszDataBuf;
+  z_stream zsDeflate; // reset for each member deflated
+  struct _DECODER *pDecoder; // reads the members being rezipped
+  struct _ARCHIVESTATS *pStats; // of the archive being processed, if wanted
+  struct _PROGRESSJOB *pProgress; // the same, for -u
   char *pszLogDir;
   char *pszErrorLogFile;
   FILE *fErrorLog;
+  int iZipStatus;              // STATUS_... of the last archive checked
+  unsigned long crcCentralDir; // of the last archive found TorrentZipped
+  struct _WORKSPACE *pMaster; // workspace owning the logs (workers only)
 } WORKSPACE;
 
 typedef struct _MIGRATE {
   unsigned int cEncounteredDirs, cEncounteredZips;
   unsigned int cRezippedZips, cOkayZips, cErrorZips;
   double ExecTime;
-  time_t StartTime;
   int bErrorEncountered;
   FILE *fProcessLog;
 } MIGRATE;
 
+WORKSPACE *AllocateWorkspace(void);
+void FreeWorkspace(WORKSPACE *ws);
+
 #endif
@@ -16,18 +16,24 @@
 #include <ctype.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <time.h>
 
 #include "logging.h"
+#include "progress.h"
 #include "util.h"
 
 #ifdef _WIN32
 #include <conio.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 static FILE *OpenLog(const char *szFileName);
 
 // Global var to store if the logprint func is expecting more
@@ -35,53 +41,73 @@ static FILE *OpenLog(const char *szFileName);
 // multipally inserted before a line terminates in a logfile.
 static char continueline = 0;
 
-// Used to print to screen and file at the same time
-void logprint(FILE *stdf, FILE *f, char *format, ...) {
-  time_t now;
-  struct tm *t;
-  va_list arglist;
-  char szTimeBuffer[2048 + 1];
-  char szMessageBuffer[2048 + 1];
+// Start of a line on the screen held back while progress is shown
+static char szHeldLine[2048 + 1];
+static FILE *fHeldLine;
 
-  // Only print the timestamp if this is the beginning of a line
-  if (!continueline) {
-    now = time(NULL);
-    t = localtime(&now);
+// A message captured by a worker thread, to be written out later by LogReplay
+typedef struct _LOGMSG {
+  struct _LOGMSG *pNext;
+  FILE *stdf, *f1, *f2;
+  char qEndsLine;
+  char szText[1];
+} LOGMSG;
 
-    snprintf(szTimeBuffer, sizeof(szTimeBuffer),
-             "[%04d/%02d/%02d - %02d:%02d:%02d] ", t->tm_year + 1900,
-             t->tm_mon + 1, t->tm_mday, t->tm_hour, t->tm_min, t->tm_sec);
-  } else {
-    szTimeBuffer[0] = 0;
-  }
+#ifdef HAVE_PTHREAD
+static pthread_once_t capture_once = PTHREAD_ONCE_INIT;
+static pthread_key_t capture_key;
+static pthread_mutex_t errorlog_lock = PTHREAD_MUTEX_INITIALIZER;
 
-  // Look for a newline in the passed data
-  continueline = !strchr(format, '\n');
+static void CreateCaptureKey(void) { pthread_key_create(&capture_key, NULL); }
 
-  va_start(arglist, format);
-  vsnprintf(szMessageBuffer, sizeof(szMessageBuffer), format, arglist);
-  va_end(arglist);
+static LOGBUF *CurrentCapture(void) {
+  pthread_once(&capture_once, CreateCaptureKey);
+  return pthread_getspecific(capture_key);
+}
+#else
+#define CurrentCapture() ((LOGBUF *)NULL)
+#endif
 
-  // Print to stdout or stderr
-  if (stdf) {
-    fprintf(stdf, "%s", szMessageBuffer);
+// Write a message to the screen. While progress is shown, only whole lines
+// go out, so the status can be drawn between them.
+static void screenwrite(FILE *stdf, char qEndsLine, const char *pszMessage) {
+  size_t cchHeld;
+
+  if (!ProgressActive(stdf)) {
+    if (szHeldLine[0]) {
+      fprintf(fHeldLine, "%s", szHeldLine);
+      fflush(fHeldLine);
+      szHeldLine[0] = 0;
+    }
+    fprintf(stdf, "%s", pszMessage);
     fflush(stdf);
+    return;
+  }
+
+  cchHeld = strlen(szHeldLine);
+  if (!qEndsLine && cchHeld + strlen(pszMessage) < sizeof(szHeldLine)) {
+    strcpy(szHeldLine + cchHeld, pszMessage);
+    fHeldLine = stdf;
+    return;
   }
 
-  // Print to logfile
-  if (f) {
-    fprintf(f, "%s%s", szTimeBuffer, szMessageBuffer);
-    fflush(f);
+  ProgressPause();
+  if (cchHeld) {
+    fprintf(fHeldLine, "%s", szHeldLine);
+    fflush(fHeldLine);
+    szHeldLine[0] = 0;
   }
+  fprintf(stdf, "%s", pszMessage);
+  fflush(stdf);
+  ProgressResume();
 }
 
-// Used to print to screen and two files at the same time
-void logprint3(FILE *stdf, FILE *f1, FILE *f2, char *format, ...) {
+// Write a formatted message to the screen and up to two log files
+static void logwrite(FILE *stdf, FILE *f1, FILE *f2, char qEndsLine,
+                     const char *pszMessage) {
   time_t now;
   struct tm *t;
-  va_list arglist;
   char szTimeBuffer[2048 + 1];
-  char szMessageBuffer[2048 + 1];
 
   // Only print the timestamp if this is the beginning of a line
   if (!continueline) {
@@ -95,31 +121,107 @@ void logprint3(FILE *stdf, FILE *f1, FILE *f2, char *format, ...) {
     szTimeBuffer[0] = 0;
   }
 
-  // Look for a newline in the passed data
-  continueline = !strchr(format, '\n');
-
-  va_start(arglist, format);
-  vsnprintf(szMessageBuffer, sizeof(szMessageBuffer), format, arglist);
-  va_end(arglist);
+  continueline = !qEndsLine;
 
   // Print to stdout or stderr
-  if (stdf) {
-    fprintf(stdf, "%s", szMessageBuffer);
-  }
+  if (stdf)
+    screenwrite(stdf, qEndsLine, pszMessage);
 
   // Print to logfile 1
   if (f1) {
-    fprintf(f1, "%s%s", szTimeBuffer, szMessageBuffer);
+    fprintf(f1, "%s%s", szTimeBuffer, pszMessage);
     fflush(f1);
   }
 
   // Print to logfile 2
   if (f2) {
-    fprintf(f2, "%s%s", szTimeBuffer, szMessageBuffer);
+    fprintf(f2, "%s%s", szTimeBuffer, pszMessage);
     fflush(f2);
   }
 }
 
+// Either write the message right away or, on a capturing thread, append it
+// to the capture buffer.
+static void logdispatch(FILE *stdf, FILE *f1, FILE *f2, const char *format,
+                        va_list arglist) {
+  char szMessageBuffer[2048 + 1];
+  // Look for a newline in the passed data
+  char qEndsLine = strchr(format, '\n') != NULL;
+  LOGBUF *lb = CurrentCapture();
+  LOGMSG *msg;
+  size_t len;
+
+  vsnprintf(szMessageBuffer, sizeof(szMessageBuffer), format, arglist);
+
+  if (!lb) {
+    logwrite(stdf, f1, f2, qEndsLine, szMessageBuffer);
+    return;
+  }
+
+  len = strlen(szMessageBuffer);
+  msg = malloc(sizeof(LOGMSG) + len);
+  if (!msg) {
+    // Better out of order than not at all. logwrite isn't safe off the
+    // main thread, stdio is.
+    if (stdf == stderr)
+      fputs(szMessageBuffer, stderr);
+    return;
+  }
+  msg->pNext = NULL;
+  msg->stdf = stdf;
+  msg->f1 = f1;
+  msg->f2 = f2;
+  msg->qEndsLine = qEndsLine;
+  memcpy(msg->szText, szMessageBuffer, len + 1);
+
+  if (lb->pLast)
+    lb->pLast->pNext = msg;
+  else
+    lb->pFirst = msg;
+  lb->pLast = msg;
+}
+
+// Used to print to screen and file at the same time
+void logprint(FILE *stdf, FILE *f, char *format, ...) {
+  va_list arglist;
+
+  va_start(arglist, format);
+  logdispatch(stdf, f, NULL, format, arglist);
+  va_end(arglist);
+}
+
+// Used to print to screen and two files at the same time
+void logprint3(FILE *stdf, FILE *f1, FILE *f2, char *format, ...) {
+  va_list arglist;
+
+  va_start(arglist, format);
+  logdispatch(stdf, f1, f2, format, arglist);
+  va_end(arglist);
+}
+
+// Make logprint on the calling thread collect messages in lb instead of
+// printing them. Pass NULL to stop capturing.
+void LogCapture(LOGBUF *lb) {
+#ifdef HAVE_PTHREAD
+  pthread_once(&capture_once, CreateCaptureKey);
+  pthread_setspecific(capture_key, lb);
+#else
+  (void)lb;
+#endif
+}
+
+// Write out and release all messages collected in lb
+void LogReplay(LOGBUF *lb) {
+  LOGMSG *msg, *next;
+
+  for (msg = lb->pFirst; msg; msg = next) {
+    next = msg->pNext;
+    logwrite(msg->stdf, msg->f1, msg->f2, msg->qEndsLine, msg->szText);
+    free(msg);
+  }
+  lb->pFirst = lb->pLast = NULL;
+}
+
 int OpenProcessLog(const char *pszWritePath, const char *pszRelPath,
                    MIGRATE *mig) {
   int iPathLen = 0;
@@ -213,6 +315,15 @@ int SetupErrorLog(WORKSPACE *ws, char qGUILaunch) {
 }
 
 FILE *ErrorLog(WORKSPACE *ws) {
+  FILE *f;
+
+  // Workers share the error log of the main workspace
+  if (ws->pMaster)
+    ws = ws->pMaster;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&errorlog_lock);
+#endif
   if (!ws->fErrorLog && ws->pszErrorLogFile && *ws->pszErrorLogFile) {
     ws->fErrorLog = OpenLog(ws->pszErrorLogFile);
     if (!ws->fErrorLog) {
@@ -221,8 +332,12 @@ FILE *ErrorLog(WORKSPACE *ws) {
       ws->pszErrorLogFile = NULL;
     }
   }
+  f = ws->fErrorLog;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&errorlog_lock);
+#endif
 
-  return ws->fErrorLog;
+  return f;
 }
 
 static FILE *OpenLog(const char *szFileName) {
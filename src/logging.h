@@ -18,6 +18,11 @@
 
 #include "global.h"
 
+// Messages collected by LogCapture, written out in order by LogReplay
+typedef struct _LOGBUF {
+  struct _LOGMSG *pFirst, *pLast;
+} LOGBUF;
+
 int OpenProcessLog(const char *pszWritePath, const char *pszRelPath,
                    MIGRATE *mig);
 int SetupErrorLog(WORKSPACE *ws, char qGUILaunch);
@@ -26,4 +31,7 @@ FILE *ErrorLog(WORKSPACE *ws);
 void logprint(FILE *stdf, FILE *f, char *format, ...);
 void logprint3(FILE *stdf, FILE *f1, FILE *f2, char *format, ...);
 
+void LogCapture(LOGBUF *lb);
+void LogReplay(LOGBUF *lb);
+
 #endif
@@ -0,0 +1,267 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "global.h"
+#include "mapfile.h"
+
+// minizip file functions for reading archives. A mapped archive is read
+// with plain memcpys, so minizip's many small reads of headers and data
+// don't each cost a trip through stdio and the kernel. Files that can't
+// be mapped fall back to stdio.
+//
+// Truncating a mapped archive while it's being read gets us killed by
+// SIGBUS. Rezipping one which is being changed is doomed anyway.
+
+struct _MAPFILE {
+  FILE *f; // if not mapped
+  const unsigned char *pData;
+  ZPOS64_T cbFile;
+  ZPOS64_T pos;
+};
+
+static int bMapFiles = 1;
+
+void MapFileEnable(int bEnable) { bMapFiles = bEnable; }
+
+#ifdef HAVE_MMAP
+static int MapFile(MAPFILE *mf, const char *pszFileName) {
+  struct stat st;
+  void *p;
+  int fd;
+
+  if ((fd = open(pszFileName, O_RDONLY)) < 0)
+    return 0;
+
+  // Empty files can't be mapped, but they aren't zips anyway
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+      (uint64_t)st.st_size > SIZE_MAX) {
+    close(fd);
+    return 0;
+  }
+
+  p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return 0;
+
+#ifdef MADV_SEQUENTIAL
+  // Members are mostly read front to back, so read ahead aggressively
+  madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+
+  mf->pData = p;
+  mf->cbFile = st.st_size;
+
+  return 1;
+}
+#endif
+
+MAPFILE *MapFileOpen(const char *pszFileName) {
+  MAPFILE *mf;
+
+  if (!(mf = calloc(1, sizeof(MAPFILE))))
+    return NULL;
+
+#ifdef HAVE_MMAP
+  if (bMapFiles && MapFile(mf, pszFileName))
+    return mf;
+#endif
+
+  if (!(mf->f = fopen64(pszFileName, "rb"))) {
+    free(mf);
+    return NULL;
+  }
+
+  if (fseeko64(mf->f, 0, SEEK_END) ||
+      (mf->cbFile = (ZPOS64_T)ftello64(mf->f)) == (ZPOS64_T)-1 ||
+      fseeko64(mf->f, 0, SEEK_SET)) {
+    fclose(mf->f);
+    free(mf);
+    return NULL;
+  }
+
+  return mf;
+}
+
+int MapFileClose(MAPFILE *mf) {
+  int rc = 0;
+
+  if (mf->f)
+    rc = fclose(mf->f);
+#ifdef HAVE_MMAP
+  else
+    munmap((void *)mf->pData, (size_t)mf->cbFile);
+#endif
+  free(mf);
+
+  return rc;
+}
+
+ZPOS64_T MapFileSize(const MAPFILE *mf) { return mf->cbFile; }
+
+// The whole file, or NULL if it isn't mapped
+const unsigned char *MapFileData(const MAPFILE *mf) {
+  return mf->f ? NULL : mf->pData;
+}
+
+// Read cb bytes at pos. Returns 0 on success, -1 on errors and when the
+// file is shorter.
+int MapFileRead(MAPFILE *mf, ZPOS64_T pos, void *buf, size_t cb) {
+  if (pos > mf->cbFile || cb > mf->cbFile - pos)
+    return -1;
+
+  if (!mf->f) {
+    memcpy(buf, mf->pData + pos, cb);
+    return 0;
+  }
+
+  return fseeko64(mf->f, (off_t)pos, SEEK_SET) || fread(buf, 1, cb, mf->f) != cb
+             ? -1
+             : 0;
+}
+
+static voidpf ZCALLBACK MapOpen(voidpf opaque, const void *filename,
+                                int mode) {
+  // Only for reading
+  if ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER) != ZLIB_FILEFUNC_MODE_READ)
+    return NULL;
+
+  // Opened already
+  if (opaque)
+    return opaque;
+
+  return filename ? MapFileOpen(filename) : NULL;
+}
+
+static uLong ZCALLBACK MapRead(voidpf opaque, voidpf stream, void *buf,
+                               uLong size) {
+  MAPFILE *mf = stream;
+
+  (void)opaque;
+
+  if (mf->f)
+    return (uLong)fread(buf, 1, (size_t)size, mf->f);
+
+  if (mf->pos >= mf->cbFile)
+    return 0;
+  if (size > mf->cbFile - mf->pos)
+    size = (uLong)(mf->cbFile - mf->pos);
+  memcpy(buf, mf->pData + mf->pos, size);
+  mf->pos += size;
+
+  return size;
+}
+
+static uLong ZCALLBACK MapWrite(voidpf opaque, voidpf stream,
+                                const void *buf, uLong size) {
+  (void)opaque;
+  (void)stream;
+  (void)buf;
+  (void)size;
+  return 0;
+}
+
+static ZPOS64_T ZCALLBACK MapTell(voidpf opaque, voidpf stream) {
+  MAPFILE *mf = stream;
+
+  (void)opaque;
+
+  return mf->f ? (ZPOS64_T)ftello64(mf->f) : mf->pos;
+}
+
+static long ZCALLBACK MapSeek(voidpf opaque, voidpf stream, ZPOS64_T offset,
+                              int origin) {
+  MAPFILE *mf = stream;
+  ZPOS64_T pos;
+  int whence;
+
+  (void)opaque;
+
+  switch (origin) {
+  case ZLIB_FILEFUNC_SEEK_CUR:
+    whence = SEEK_CUR;
+    pos = mf->pos;
+    break;
+  case ZLIB_FILEFUNC_SEEK_END:
+    whence = SEEK_END;
+    pos = mf->cbFile;
+    break;
+  case ZLIB_FILEFUNC_SEEK_SET:
+    whence = SEEK_SET;
+    pos = 0;
+    break;
+  default:
+    return -1;
+  }
+
+  if (mf->f)
+    return fseeko64(mf->f, (off_t)offset, whence) ? -1 : 0;
+
+  // Negative offsets arrive wrapped around
+  pos += offset;
+  if (pos > mf->cbFile)
+    return -1;
+  mf->pos = pos;
+
+  return 0;
+}
+
+static int ZCALLBACK MapClose(voidpf opaque, voidpf stream) {
+  (void)opaque;
+  return MapFileClose(stream);
+}
+
+static int ZCALLBACK MapError(voidpf opaque, voidpf stream) {
+  MAPFILE *mf = stream;
+
+  (void)opaque;
+
+  return mf->f ? ferror(mf->f) : 0;
+}
+
+static unzFile UnzOpen(const char *pszZipFileName, MAPFILE *mf) {
+  zlib_filefunc64_def ff;
+
+  ff.zopen64_file = MapOpen;
+  ff.zread_file = MapRead;
+  ff.zwrite_file = MapWrite;
+  ff.ztell64_file = MapTell;
+  ff.zseek64_file = MapSeek;
+  ff.zclose_file = MapClose;
+  ff.zerror_file = MapError;
+  ff.opaque = mf;
+
+  return unzOpen2_64(pszZipFileName ? pszZipFileName : "", &ff);
+}
+
+unzFile MapFileUnzOpen(const char *pszZipFileName) {
+  return UnzOpen(pszZipFileName, NULL);
+}
+
+// Open the zip in mf, which is closed along with the zip from now on (or
+// right away if this fails)
+unzFile MapFileUnzip(MAPFILE *mf) { return UnzOpen(NULL, mf); }
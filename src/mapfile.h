@@ -0,0 +1,37 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#ifndef MAPFILE_DOT_H
+#define MAPFILE_DOT_H
+
+#include "global.h"
+
+// A file opened for reading, memory mapped if possible
+typedef struct _MAPFILE MAPFILE;
+
+// Memory map files (default) or read them with stdio. Must be set before
+// any file is opened.
+void MapFileEnable(int bEnable);
+
+MAPFILE *MapFileOpen(const char *pszFileName);
+int MapFileClose(MAPFILE *mf);
+ZPOS64_T MapFileSize(const MAPFILE *mf);
+const unsigned char *MapFileData(const MAPFILE *mf);
+int MapFileRead(MAPFILE *mf, ZPOS64_T pos, void *buf, size_t cb);
+
+unzFile MapFileUnzOpen(const char *pszZipFileName);
+unzFile MapFileUnzip(MAPFILE *mf);
+
+#endif
@@ -0,0 +1,371 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "global.h"
+#include "mapfile.h"
+#include "member.h"
+#include "minizip/unzip.h"
+#include "tzwriter.h"
+
+// Compress members of one archive on several threads while the caller
+// writes them into the new zip in canonical order. Members are only
+// compressed a limited number of entries and bytes ahead of the caller.
+
+// Inflate the current member (described by pInfo) and deflate it into m
+// with zs (set up by TzDeflateInit). With digest, the SHA-256 of the data
+// is computed on the way.
+// Anything unexpected leaves the member to the caller, which then reports
+// the problem just like without parallel compression.
+static int CompressMember(unzFile UnZipHandle, const unz_file_info64 *pInfo,
+                          unsigned char *pReadBuf, unsigned int cbReadBuf,
+                          z_stream *zs, MEMBER *m, unsigned char *digest) {
+  SHA256 sha;
+  size_t cbOut;
+  int iBytesRead, rc;
+  int bOk = 0;
+
+  if (deflateReset(zs) != Z_OK)
+    return 0;
+
+  cbOut = deflateBound(zs, pInfo->uncompressed_size);
+  m->pData = malloc(cbOut ? cbOut : 1);
+  m->cUncompressed = 0;
+  zs->next_out = m->pData;
+  zs->avail_out = cbOut;
+  Sha256Init(&sha);
+
+  if (m->pData && unzOpenCurrentFile(UnZipHandle) == UNZ_OK) {
+    for (;;) {
+      iBytesRead = unzReadCurrentFile(UnZipHandle, pReadBuf, cbReadBuf);
+      if (iBytesRead < 0)
+        break;
+
+      m->cUncompressed += iBytesRead;
+      if (digest)
+        Sha256Update(&sha, pReadBuf, iBytesRead);
+
+      zs->next_in = pReadBuf;
+      zs->avail_in = iBytesRead;
+      rc = deflate(zs, iBytesRead ? Z_NO_FLUSH : Z_FINISH);
+      // Output space is sized for the worst case, running out means the
+      // header lied about the size.
+      if (rc == Z_STREAM_END) {
+        bOk = m->cUncompressed == pInfo->uncompressed_size;
+        break;
+      }
+      if (rc != Z_OK || zs->avail_in || !zs->avail_out)
+        break;
+    }
+
+    // All data was read, so this checks the CRC
+    if (unzCloseCurrentFile(UnZipHandle) != UNZ_OK)
+      bOk = 0;
+  }
+
+  if (bOk) {
+    m->crc = pInfo->crc;
+    m->cbData = cbOut - zs->avail_out;
+    if (digest)
+      Sha256Final(&sha, digest);
+  } else {
+    free(m->pData);
+    m->pData = NULL;
+  }
+
+  return bOk;
+}
+
+// Compute the SHA-256 of the current member (described by pInfo)
+static int DigestMember(unzFile UnZipHandle, const unz_file_info64 *pInfo,
+                        unsigned char *pReadBuf, unsigned int cbReadBuf,
+                        unsigned char *digest) {
+  SHA256 sha;
+  ZPOS64_T cData = 0;
+  int iBytesRead;
+
+  if (unzOpenCurrentFile(UnZipHandle) != UNZ_OK)
+    return 0;
+
+  Sha256Init(&sha);
+  while ((iBytesRead = unzReadCurrentFile(UnZipHandle, pReadBuf, cbReadBuf)) >
+         0) {
+    Sha256Update(&sha, pReadBuf, iBytesRead);
+    cData += iBytesRead;
+  }
+  Sha256Final(&sha, digest);
+
+  // unzCloseCurrentFile checks the CRC
+  return unzCloseCurrentFile(UnZipHandle) == UNZ_OK && !iBytesRead &&
+         cData == pInfo->uncompressed_size;
+}
+
+// Compress the member at pos into m, or take the result from the stream
+// cache sc (if not NULL), which learns about members compressed here.
+// pReadBuf holds cbReadBuf bytes, zs is set up by TzDeflateInit. Returns 0
+// if the caller has to process the member itself.
+int MemberCompress(unzFile UnZipHandle, unz64_file_pos *pos,
+                   unsigned char *pReadBuf, unsigned int cbReadBuf,
+                   z_stream *zs, MEMBER *m, STREAMCACHE *sc) {
+  unz_file_info64 ZipInfo;
+  unsigned char digest[SHA256_SIZE];
+
+  if (unzGoToFilePos64(UnZipHandle, pos) != UNZ_OK ||
+      unzGetCurrentFileInfo64(UnZipHandle, &ZipInfo, NULL, 0, NULL, 0, NULL,
+                              0) != UNZ_OK ||
+      ZipInfo.uncompressed_size > MEMBER_MAX_BUFFERED)
+    return 0;
+
+  if (ZipInfo.uncompressed_size < STREAMCACHE_MIN_SIZE)
+    sc = NULL;
+
+  // Only pay for the SHA-256 up front if the cache may have the stream
+  if (sc && StreamCacheHas(sc, ZipInfo.crc, ZipInfo.uncompressed_size) &&
+      DigestMember(UnZipHandle, &ZipInfo, pReadBuf, cbReadBuf, digest) &&
+      (m->pData = StreamCacheGet(sc, ZipInfo.crc, ZipInfo.uncompressed_size,
+                                 digest, &m->cbData))) {
+    m->crc = ZipInfo.crc;
+    m->cUncompressed = ZipInfo.uncompressed_size;
+    return 1;
+  }
+
+  if (!CompressMember(UnZipHandle, &ZipInfo, pReadBuf, cbReadBuf, zs, m,
+                      sc ? digest : NULL))
+    return 0;
+
+  if (sc)
+    StreamCachePut(sc, m->crc, m->cUncompressed, digest, m->pData, m->cbData);
+
+  return 1;
+}
+
+#ifdef HAVE_PTHREAD
+
+#define MEMBER_READ_SIZE (64 * 1024)
+
+// States of a member slot
+#define SLOT_WAITING 0
+#define SLOT_BUSY 1
+#define SLOT_DONE 2   // pData valid
+#define SLOT_UNUSED 3 // caller has to do it
+
+typedef struct _SLOT {
+  MEMBER m;
+  size_t cbCharge; // memory it takes while busy or done
+  int iState;
+} SLOT;
+
+struct _MEMBERS {
+  char *pszZipFileName;
+  unz64_file_pos *Positions;
+  SLOT *Slots;
+  STREAMCACHE *sc;
+  int iCount;
+  int iNext;       // next member to be compressed
+  int iCurrent;    // member the caller is working on
+  int iWindow;     // how far iNext may run ahead of iCurrent
+  size_t cbWindow; // sum of cbCharge of busy and done slots
+  int bStop;
+  int iThreads;
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+// Whether member iNext has to wait until the caller catches up. The one
+// the caller waits for is always handed out. Called with the lock held.
+static int WindowFull(const MEMBERS *ms) {
+  return ms->iNext > ms->iCurrent &&
+         (ms->iNext >= ms->iCurrent + ms->iWindow ||
+          ms->cbWindow + ms->Slots[ms->iNext].cbCharge > MEMBER_MAX_WINDOW);
+}
+
+// Mark slot i as no longer holding data. Called with the lock held.
+static void ReleaseSlot(MEMBERS *ms, int i) {
+  free(ms->Slots[i].m.pData);
+  ms->Slots[i].m.pData = NULL;
+  ms->Slots[i].iState = SLOT_UNUSED;
+  ms->cbWindow -= ms->Slots[i].cbCharge;
+}
+
+static void *MemberThread(void *arg) {
+  MEMBERS *ms = arg;
+  unzFile UnZipHandle = MapFileUnzOpen(ms->pszZipFileName);
+  unsigned char *pReadBuf = malloc(MEMBER_READ_SIZE);
+  z_stream zs;
+  int bDeflate = TzDeflateInit(&zs) == Z_OK;
+  int i, bOk;
+
+  pthread_mutex_lock(&ms->lock);
+  for (;;) {
+    while (!ms->bStop && ms->iNext < ms->iCount && WindowFull(ms))
+      pthread_cond_wait(&ms->cond, &ms->lock);
+    if (ms->bStop || ms->iNext >= ms->iCount)
+      break;
+
+    i = ms->iNext++;
+    ms->Slots[i].iState = SLOT_BUSY;
+    ms->cbWindow += ms->Slots[i].cbCharge;
+    pthread_mutex_unlock(&ms->lock);
+
+    bOk = UnZipHandle && pReadBuf && bDeflate &&
+          MemberCompress(UnZipHandle, &ms->Positions[i], pReadBuf,
+                         MEMBER_READ_SIZE, &zs, &ms->Slots[i].m, ms->sc);
+
+    pthread_mutex_lock(&ms->lock);
+    // Members skipped by the caller are dropped right away
+    if (bOk && i >= ms->iCurrent)
+      ms->Slots[i].iState = SLOT_DONE;
+    else
+      ReleaseSlot(ms, i);
+    pthread_cond_broadcast(&ms->cond);
+  }
+  pthread_mutex_unlock(&ms->lock);
+
+  free(pReadBuf);
+  if (bDeflate)
+    deflateEnd(&zs);
+  if (UnZipHandle)
+    unzClose(UnZipHandle);
+
+  return NULL;
+}
+
+// Start compressing the iCount members listed in Entries (in the
+// order they will be requested) with iThreads threads, using the stream
+// cache sc if not NULL. Returns NULL if there is nothing to gain, in
+// which case the caller does all the work.
+MEMBERS *MembersStart(const char *pszZipFileName, const ZIPENTRY *Entries,
+                      int iCount, int iThreads, STREAMCACHE *sc) {
+  MEMBERS *ms;
+  int i;
+
+  if (iThreads < 2 || iCount < 2)
+    return NULL;
+  if (iThreads > iCount)
+    iThreads = iCount;
+
+  if (!(ms = calloc(1, sizeof(MEMBERS))))
+    return NULL;
+
+  ms->iCount = iCount;
+  ms->iWindow = 2 * iThreads;
+  ms->sc = sc;
+  ms->pszZipFileName = strdup(pszZipFileName);
+  ms->Positions = calloc(iCount, sizeof(unz64_file_pos));
+  ms->Slots = calloc(iCount, sizeof(SLOT));
+  ms->threads = calloc(iThreads, sizeof(pthread_t));
+  if (!ms->pszZipFileName || !ms->Positions || !ms->Slots || !ms->threads) {
+    MembersStop(ms);
+    return NULL;
+  }
+
+  // Bigger members are left to the caller without taking memory
+  for (i = 0; i < iCount; i++) {
+    ms->Positions[i] = Entries[i].pos;
+    if (Entries[i].cUncompressed <= MEMBER_MAX_BUFFERED)
+      ms->Slots[i].cbCharge = (size_t)Entries[i].cUncompressed;
+  }
+
+  pthread_mutex_init(&ms->lock, NULL);
+  pthread_cond_init(&ms->cond, NULL);
+
+  for (; ms->iThreads < iThreads; ms->iThreads++)
+    if (pthread_create(&ms->threads[ms->iThreads], NULL, MemberThread, ms))
+      break;
+
+  if (!ms->iThreads) {
+    MembersStop(ms);
+    return NULL;
+  }
+
+  return ms;
+}
+
+// Wait for member iIndex. Returns NULL if the caller has to process it
+// itself. Members before iIndex are released, so the returned data is
+// valid until the next call.
+const MEMBER *MembersGet(MEMBERS *ms, int iIndex) {
+  SLOT *pSlot = &ms->Slots[iIndex];
+  int i;
+
+  pthread_mutex_lock(&ms->lock);
+  // Members still being worked on are released by their thread
+  for (i = ms->iCurrent; i < iIndex; i++)
+    if (ms->Slots[i].iState == SLOT_DONE)
+      ReleaseSlot(ms, i);
+  ms->iCurrent = iIndex;
+  pthread_cond_broadcast(&ms->cond);
+
+  // iIndex is always handed out, so a thread will get to it
+  while (pSlot->iState == SLOT_WAITING || pSlot->iState == SLOT_BUSY)
+    pthread_cond_wait(&ms->cond, &ms->lock);
+  pthread_mutex_unlock(&ms->lock);
+
+  return pSlot->iState == SLOT_DONE ? &pSlot->m : NULL;
+}
+
+void MembersStop(MEMBERS *ms) {
+  int i;
+
+  if (ms->iThreads) {
+    pthread_mutex_lock(&ms->lock);
+    ms->bStop = 1;
+    pthread_cond_broadcast(&ms->cond);
+    pthread_mutex_unlock(&ms->lock);
+
+    for (i = 0; i < ms->iThreads; i++)
+      pthread_join(ms->threads[i], NULL);
+
+    pthread_cond_destroy(&ms->cond);
+    pthread_mutex_destroy(&ms->lock);
+  }
+
+  for (i = 0; ms->Slots && i < ms->iCount; i++)
+    free(ms->Slots[i].m.pData);
+  free(ms->Positions);
+  free(ms->Slots);
+  free(ms->threads);
+  free(ms->pszZipFileName);
+  free(ms);
+}
+
+#else // !HAVE_PTHREAD
+
+MEMBERS *MembersStart(const char *pszZipFileName, const ZIPENTRY *Entries,
+                      int iCount, int iThreads, STREAMCACHE *sc) {
+  (void)pszZipFileName;
+  (void)Entries;
+  (void)iCount;
+  (void)iThreads;
+  (void)sc;
+  return NULL;
+}
+
+const MEMBER *MembersGet(MEMBERS *ms, int iIndex) {
+  (void)ms;
+  (void)iIndex;
+  return NULL;
+}
+
+void MembersStop(MEMBERS *ms) { (void)ms; }
+
+#endif
@@ -0,0 +1,50 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#ifndef MEMBER_DOT_H
+#define MEMBER_DOT_H
+
+#include "global.h"
+#include "streamcache.h"
+
+// Largest member (uncompressed) that gets compressed ahead into memory.
+// Bigger ones are left to the caller.
+#define MEMBER_MAX_BUFFERED (64 * 1024 * 1024)
+
+// Members compressed ahead hold at most this much memory, apart from the
+// one the caller waits for
+#define MEMBER_MAX_WINDOW (256 * 1024 * 1024)
+
+// A member deflated with the settings of TzDeflateInit, exactly like
+// TzWriterWrite would, ready to be stored with TzWriterOpenRawMember.
+typedef struct _MEMBER {
+  unsigned char *pData;
+  size_t cbData;
+  uLong crc;
+  ZPOS64_T cUncompressed;
+} MEMBER;
+
+typedef struct _MEMBERS MEMBERS;
+
+int MemberCompress(unzFile UnZipHandle, unz64_file_pos *pos,
+                   unsigned char *pReadBuf, unsigned int cbReadBuf,
+                   z_stream *zs, MEMBER *m, STREAMCACHE *sc);
+
+MEMBERS *MembersStart(const char *pszZipFileName, const ZIPENTRY *Entries,
+                      int iCount, int iThreads, STREAMCACHE *sc);
+const MEMBER *MembersGet(MEMBERS *ms, int iIndex);
+void MembersStop(MEMBERS *ms);
+
+#endif
@@ -74,6 +74,7 @@
 
 #include "zlib.h"
 #include "unzip.h"
+#include "../crc32.h"
 
 #ifdef STDC
 #  include <stddef.h>
@@ -177,6 +178,9 @@ typedef struct
     unz_file_info64_internal cur_file_info_internal; /* private info about it*/
     file_in_zip64_read_info_s* pfile_in_zip_read; /* structure about the current
                                         file if we are decompressing it */
+    file_in_zip64_read_info_s* pfile_in_zip_read_unused; /* kept from the last
+                                        file, with its buffer and inflate state,
+                                        for the next one */
     int encrypted;
 
     int isZip64;
@@ -320,6 +324,20 @@ extern int ZEXPORT unzStringFileNameCompare (const char*  fileName1,
 #define CENTRALDIRINVALID ((ZPOS64_T)(-1))
 #endif
 
+/*
+  Free the read info of a file, with its buffer and decompression state
+*/
+local void unz64local_FreeReadInfo(file_in_zip64_read_info_s* pfile_in_zip_read_info) {
+    free(pfile_in_zip_read_info->read_buffer);
+    if (pfile_in_zip_read_info->stream_initialised == Z_DEFLATED)
+        inflateEnd(&pfile_in_zip_read_info->stream);
+#ifdef HAVE_BZIP2
+    else if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
+        BZ2_bzDecompressEnd(&pfile_in_zip_read_info->bstream);
+#endif
+    free(pfile_in_zip_read_info);
+}
+
 /*
   Locate the Central directory of a zipfile (at the end, just before
     the global comment)
@@ -656,6 +674,7 @@ local unzFile unzOpenInternal(const void *path,
                             (us.offset_central_dir+us.size_central_dir);
     us.central_pos = central_pos;
     us.pfile_in_zip_read = NULL;
+    us.pfile_in_zip_read_unused = NULL;
     us.encrypted = 0;
 
 
@@ -716,6 +735,8 @@ extern int ZEXPORT unzClose(unzFile file) {
 
     if (s->pfile_in_zip_read!=NULL)
         unzCloseCurrentFile(file);
+    if (s->pfile_in_zip_read_unused!=NULL)
+        unz64local_FreeReadInfo(s->pfile_in_zip_read_unused);
 
     ZCLOSE64(s->z_filefunc, s->filestream);
     free(s);
@@ -1367,24 +1388,30 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method,
     if (unz64local_CheckCurrentFileCoherencyHeader(s,&iSizeVar, &offset_local_extrafield,&size_local_extrafield)!=UNZ_OK)
         return UNZ_BADZIPFILE;
 
-    pfile_in_zip_read_info = (file_in_zip64_read_info_s*)ALLOC(sizeof(file_in_zip64_read_info_s));
+    /* The buffer and inflate state of the last file are used again */
+    pfile_in_zip_read_info = s->pfile_in_zip_read_unused;
+    s->pfile_in_zip_read_unused = NULL;
     if (pfile_in_zip_read_info==NULL)
-        return UNZ_INTERNALERROR;
+    {
+        pfile_in_zip_read_info = (file_in_zip64_read_info_s*)ALLOC(sizeof(file_in_zip64_read_info_s));
+        if (pfile_in_zip_read_info==NULL)
+            return UNZ_INTERNALERROR;
+
+        pfile_in_zip_read_info->read_buffer=(char*)ALLOC(UNZ_BUFSIZE);
+        if (pfile_in_zip_read_info->read_buffer==NULL)
+        {
+            free(pfile_in_zip_read_info);
+            return UNZ_INTERNALERROR;
+        }
+
+        pfile_in_zip_read_info->stream_initialised=0;
+    }
 
-    pfile_in_zip_read_info->read_buffer=(char*)ALLOC(UNZ_BUFSIZE);
     pfile_in_zip_read_info->offset_local_extrafield = offset_local_extrafield;
     pfile_in_zip_read_info->size_local_extrafield = size_local_extrafield;
     pfile_in_zip_read_info->pos_local_extrafield=0;
     pfile_in_zip_read_info->raw=raw;
 
-    if (pfile_in_zip_read_info->read_buffer==NULL)
-    {
-        free(pfile_in_zip_read_info);
-        return UNZ_INTERNALERROR;
-    }
-
-    pfile_in_zip_read_info->stream_initialised=0;
-
     if (method!=NULL)
         *method = (int)s->cur_file_info.compression_method;
 
@@ -1420,6 +1447,12 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method,
     if ((s->cur_file_info.compression_method==Z_BZIP2ED) && (!raw))
     {
 #ifdef HAVE_BZIP2
+      if (pfile_in_zip_read_info->stream_initialised == Z_DEFLATED)
+      {
+        inflateEnd(&pfile_in_zip_read_info->stream);
+        pfile_in_zip_read_info->stream_initialised = 0;
+      }
+
       pfile_in_zip_read_info->bstream.bzalloc = (void *(*) (void *, int, int))0;
       pfile_in_zip_read_info->bstream.bzfree = (free_func)0;
       pfile_in_zip_read_info->bstream.opaque = (voidpf)0;
@@ -1436,8 +1469,7 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method,
         pfile_in_zip_read_info->stream_initialised=Z_BZIP2ED;
       else
       {
-        free(pfile_in_zip_read_info->read_buffer);
-        free(pfile_in_zip_read_info);
+        unz64local_FreeReadInfo(pfile_in_zip_read_info);
         return err;
       }
 #else
@@ -1446,19 +1478,23 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method,
     }
     else if ((s->cur_file_info.compression_method==Z_DEFLATED) && (!raw))
     {
-      pfile_in_zip_read_info->stream.zalloc = (alloc_func)0;
-      pfile_in_zip_read_info->stream.zfree = (free_func)0;
-      pfile_in_zip_read_info->stream.opaque = (voidpf)0;
-      pfile_in_zip_read_info->stream.next_in = 0;
-      pfile_in_zip_read_info->stream.avail_in = 0;
-
-      err=inflateInit2(&pfile_in_zip_read_info->stream, -MAX_WBITS);
-      if (err == Z_OK)
-        pfile_in_zip_read_info->stream_initialised=Z_DEFLATED;
+      if (pfile_in_zip_read_info->stream_initialised == Z_DEFLATED)
+        err=inflateReset(&pfile_in_zip_read_info->stream);
       else
       {
-        free(pfile_in_zip_read_info->read_buffer);
-        free(pfile_in_zip_read_info);
+        pfile_in_zip_read_info->stream.zalloc = (alloc_func)0;
+        pfile_in_zip_read_info->stream.zfree = (free_func)0;
+        pfile_in_zip_read_info->stream.opaque = (voidpf)0;
+        pfile_in_zip_read_info->stream.next_in = 0;
+        pfile_in_zip_read_info->stream.avail_in = 0;
+
+        err=inflateInit2(&pfile_in_zip_read_info->stream, -MAX_WBITS);
+        if (err == Z_OK)
+          pfile_in_zip_read_info->stream_initialised=Z_DEFLATED;
+      }
+      if (err != Z_OK)
+      {
+        unz64local_FreeReadInfo(pfile_in_zip_read_info);
         return err;
       }
         /* windowBits is passed < 0 to tell that there is no zlib header.
@@ -1648,7 +1684,7 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, unsigned len) {
 
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uDoCopy;
 
-            pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
+            pfile_in_zip_read_info->crc32 = Crc32(pfile_in_zip_read_info->crc32,
                                 pfile_in_zip_read_info->stream.next_out,
                                 uDoCopy);
             pfile_in_zip_read_info->rest_read_uncompressed-=uDoCopy;
@@ -1685,7 +1721,7 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, unsigned len) {
 
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uOutThis;
 
-            pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,bufBefore, (uInt)(uOutThis));
+            pfile_in_zip_read_info->crc32 = Crc32(pfile_in_zip_read_info->crc32,bufBefore, (uInt)(uOutThis));
             pfile_in_zip_read_info->rest_read_uncompressed -= uOutThis;
             iRead += (uInt)(uTotalOutAfter - uTotalOutBefore);
 
@@ -1732,7 +1768,7 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, unsigned len) {
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uOutThis;
 
             pfile_in_zip_read_info->crc32 =
-                crc32(pfile_in_zip_read_info->crc32,bufBefore,
+                Crc32(pfile_in_zip_read_info->crc32,bufBefore,
                         (uInt)(uOutThis));
 
             pfile_in_zip_read_info->rest_read_uncompressed -=
@@ -1889,19 +1925,16 @@ extern int ZEXPORT unzCloseCurrentFile(unzFile file) {
     }
 
 
-    free(pfile_in_zip_read_info->read_buffer);
-    pfile_in_zip_read_info->read_buffer = NULL;
-    if (pfile_in_zip_read_info->stream_initialised == Z_DEFLATED)
-        inflateEnd(&pfile_in_zip_read_info->stream);
 #ifdef HAVE_BZIP2
-    else if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
+    if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
+    {
         BZ2_bzDecompressEnd(&pfile_in_zip_read_info->bstream);
+        pfile_in_zip_read_info->stream_initialised = 0;
+    }
 #endif
 
-
-    pfile_in_zip_read_info->stream_initialised = 0;
-    free(pfile_in_zip_read_info);
-
+    /* Keep the buffer and the inflate state for the next file */
+    s->pfile_in_zip_read_unused = pfile_in_zip_read_info;
     s->pfile_in_zip_read=NULL;
 
     return err;
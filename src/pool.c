@@ -0,0 +1,280 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "global.h"
+#include "logging.h"
+#include "pool.h"
+
+// Number of jobs (per worker) the walker may run ahead of the oldest
+// unfinished job. Bounds the memory held by captured log output.
+#define JOBS_PER_THREAD 4
+
+typedef struct _POOLJOB {
+  struct _POOLJOB *pNext;
+  POOL_RUN run;
+  POOL_RETIRE retire;
+  void *arg;
+  int rc;
+  int bDone;
+  LOGBUF log;
+} POOLJOB;
+
+static struct {
+  int iThreads;
+  int rc; // sticky TZ_CRITICAL once any job failed critically
+  WORKSPACE *ws; // used when running serially
+#ifdef HAVE_PTHREAD
+  pthread_t *threads;
+  WORKSPACE **workspaces;
+  pthread_mutex_t lock;
+  pthread_cond_t work; // signalled when a job is submitted or on shutdown
+  pthread_cond_t done; // signalled when a job has been run
+  POOLJOB *pHead, *pTail; // all unretired jobs in submission order
+  POOLJOB *pNextRun;      // oldest job not yet picked up by a worker
+  int cPending;
+  int bStop;
+  POOLJOB *pLogJob; // collects PoolLogBegin/PoolLogEnd output
+#endif
+} pool;
+
+static int RetireJob(POOL_RETIRE retire, void *arg, int rc) {
+  if (retire && retire(arg, rc) == TZ_CRITICAL)
+    pool.rc = TZ_CRITICAL;
+  return pool.rc;
+}
+
+#ifdef HAVE_PTHREAD
+static void *WorkerThread(void *arg) {
+  WORKSPACE *ws = arg;
+  POOLJOB *job;
+
+  pthread_mutex_lock(&pool.lock);
+  for (;;) {
+    // Jobs without run function have nothing to do on a worker
+    while (pool.pNextRun && !pool.pNextRun->run)
+      pool.pNextRun = pool.pNextRun->pNext;
+
+    if (!pool.pNextRun) {
+      if (pool.bStop)
+        break;
+      pthread_cond_wait(&pool.work, &pool.lock);
+      continue;
+    }
+
+    job = pool.pNextRun;
+    pool.pNextRun = job->pNext;
+    pthread_mutex_unlock(&pool.lock);
+
+    LogCapture(&job->log);
+    job->rc = job->run(job->arg, ws);
+    LogCapture(NULL);
+
+    pthread_mutex_lock(&pool.lock);
+    job->bDone = 1;
+    pthread_cond_broadcast(&pool.done);
+  }
+  pthread_mutex_unlock(&pool.lock);
+
+  return NULL;
+}
+
+// Retire finished jobs from the head of the queue. Waits until no more than
+// iMaxPending jobs are left. Must be called with the lock held.
+static void RetireFinished(int iMaxPending) {
+  POOLJOB *job;
+
+  while (pool.pHead) {
+    if (!pool.pHead->bDone) {
+      if (pool.cPending <= iMaxPending)
+        break;
+      pthread_cond_wait(&pool.done, &pool.lock);
+      continue;
+    }
+
+    job = pool.pHead;
+    pool.pHead = job->pNext;
+    if (!pool.pHead)
+      pool.pTail = NULL;
+    pool.cPending--;
+    pthread_mutex_unlock(&pool.lock);
+
+    LogReplay(&job->log);
+    RetireJob(job->retire, job->arg, job->rc);
+    free(job);
+
+    pthread_mutex_lock(&pool.lock);
+  }
+}
+
+static void Enqueue(POOLJOB *job) {
+  pthread_mutex_lock(&pool.lock);
+  if (pool.pTail)
+    pool.pTail->pNext = job;
+  else
+    pool.pHead = job;
+  pool.pTail = job;
+  if (!pool.pNextRun && job->run)
+    pool.pNextRun = job;
+  pool.cPending++;
+  pthread_cond_signal(&pool.work);
+
+  RetireFinished(pool.iThreads * JOBS_PER_THREAD);
+  pthread_mutex_unlock(&pool.lock);
+}
+#endif
+
+// Start iThreads workers. With less than two threads jobs are simply run
+// in PoolSubmit using ws.
+int PoolStart(int iThreads, WORKSPACE *ws) {
+  pool.ws = ws;
+  pool.rc = TZ_OK;
+  pool.iThreads = 0;
+
+  if (iThreads < 2)
+    return TZ_OK;
+
+#ifdef HAVE_PTHREAD
+  pool.threads = calloc(iThreads, sizeof(pthread_t));
+  pool.workspaces = calloc(iThreads, sizeof(WORKSPACE *));
+  if (!pool.threads || !pool.workspaces) {
+    free(pool.threads);
+    free(pool.workspaces);
+    return TZ_CRITICAL;
+  }
+
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.work, NULL);
+  pthread_cond_init(&pool.done, NULL);
+  pool.bStop = 0;
+
+  for (; pool.iThreads < iThreads; pool.iThreads++) {
+    WORKSPACE *wws = AllocateWorkspace();
+
+    if (!wws)
+      break;
+    wws->pMaster = ws;
+    if (pthread_create(&pool.threads[pool.iThreads], NULL, WorkerThread, wws)) {
+      FreeWorkspace(wws);
+      break;
+    }
+    pool.workspaces[pool.iThreads] = wws;
+  }
+
+  if (pool.iThreads < iThreads) {
+    PoolStop();
+    return TZ_CRITICAL;
+  }
+#else
+  fprintf(stderr, "Parallel processing is not supported on this platform, "
+                  "using a single thread.\n");
+#endif
+
+  return TZ_OK;
+}
+
+// Retire all outstanding jobs and stop the workers
+void PoolStop(void) {
+#ifdef HAVE_PTHREAD
+  int i;
+
+  if (!pool.threads)
+    return;
+
+  PoolDrain();
+
+  pthread_mutex_lock(&pool.lock);
+  pool.bStop = 1;
+  pthread_cond_broadcast(&pool.work);
+  pthread_mutex_unlock(&pool.lock);
+
+  for (i = 0; i < pool.iThreads; i++) {
+    pthread_join(pool.threads[i], NULL);
+    FreeWorkspace(pool.workspaces[i]);
+  }
+
+  pthread_cond_destroy(&pool.done);
+  pthread_cond_destroy(&pool.work);
+  pthread_mutex_destroy(&pool.lock);
+  free(pool.threads);
+  free(pool.workspaces);
+  pool.threads = NULL;
+  pool.workspaces = NULL;
+  pool.iThreads = 0;
+#endif
+}
+
+// Queue a job. Returns TZ_CRITICAL if any job retired so far failed
+// critically, TZ_OK otherwise.
+int PoolSubmit(POOL_RUN run, POOL_RETIRE retire, void *arg) {
+#ifdef HAVE_PTHREAD
+  POOLJOB *job;
+
+  if (pool.iThreads) {
+    if (!(job = calloc(1, sizeof(POOLJOB)))) {
+      pool.rc = TZ_CRITICAL;
+      return pool.rc;
+    }
+    job->run = run;
+    job->retire = retire;
+    job->arg = arg;
+    job->bDone = !run;
+    Enqueue(job);
+    return pool.rc;
+  }
+#endif
+
+  return RetireJob(retire, arg, run ? run(arg, pool.ws) : TZ_OK);
+}
+
+// Wait for all queued jobs and retire them
+int PoolDrain(void) {
+#ifdef HAVE_PTHREAD
+  if (pool.iThreads) {
+    pthread_mutex_lock(&pool.lock);
+    RetireFinished(0);
+    pthread_mutex_unlock(&pool.lock);
+  }
+#endif
+  return pool.rc;
+}
+
+int PoolFailed(void) { return pool.rc == TZ_CRITICAL; }
+
+void PoolLogBegin(void) {
+#ifdef HAVE_PTHREAD
+  if (pool.iThreads && !pool.pLogJob &&
+      (pool.pLogJob = calloc(1, sizeof(POOLJOB)))) {
+    pool.pLogJob->bDone = 1;
+    LogCapture(&pool.pLogJob->log);
+  }
+#endif
+}
+
+void PoolLogEnd(void) {
+#ifdef HAVE_PTHREAD
+  if (pool.pLogJob) {
+    LogCapture(NULL);
+    Enqueue(pool.pLogJob);
+    pool.pLogJob = NULL;
+  }
+#endif
+}
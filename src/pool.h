@@ -0,0 +1,40 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#ifndef POOL_DOT_H
+#define POOL_DOT_H
+
+#include "global.h"
+
+// Jobs are run by a worker (with the worker's own WORKSPACE) and then
+// retired on the main thread strictly in submission order. Log output of
+// the run function is held back and written just before the job is retired,
+// so the logs look exactly as if everything had been processed serially.
+// A job without run function only gets retired.
+typedef int (*POOL_RUN)(void *arg, WORKSPACE *ws);
+typedef int (*POOL_RETIRE)(void *arg, int rc);
+
+int PoolStart(int iThreads, WORKSPACE *ws);
+void PoolStop(void);
+int PoolSubmit(POOL_RUN run, POOL_RETIRE retire, void *arg);
+int PoolDrain(void);
+int PoolFailed(void);
+
+// Messages logged between PoolLogBegin and PoolLogEnd on the main thread are
+// kept in order with the output of submitted jobs.
+void PoolLogBegin(void);
+void PoolLogEnd(void);
+
+#endif
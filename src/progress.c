@@ -0,0 +1,310 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <sched.h>
+#endif
+
+#include "progress.h"
+#include "stats.h"
+
+// Counters are only ever added to, and read for showing them. Without
+// atomics concurrent updates may get lost, which makes the status a bit
+// off but does no harm.
+#if defined(HAVE_STDATOMIC_H) && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+typedef atomic_uint_least64_t COUNTER;
+#define CounterAdd(c, x)                                                       \
+  atomic_fetch_add_explicit(&(c), (x), memory_order_relaxed)
+#define CounterGet(c) atomic_load_explicit(&(c), memory_order_relaxed)
+#define CounterSet(c, x)                                                       \
+  atomic_store_explicit(&(c), (x), memory_order_relaxed)
+static atomic_flag Drawing = ATOMIC_FLAG_INIT;
+#define TryLock()                                                              \
+  (!atomic_flag_test_and_set_explicit(&Drawing, memory_order_acquire))
+#define Unlock() atomic_flag_clear_explicit(&Drawing, memory_order_release)
+#else
+typedef uint64_t COUNTER;
+#define CounterAdd(c, x) ((c) += (x))
+#define CounterGet(c) (c)
+#define CounterSet(c, x) ((c) = (x))
+static volatile int Drawing;
+#define TryLock() (Drawing ? 0 : (Drawing = 1))
+#define Unlock() (Drawing = 0)
+#endif
+
+// Longest status line drawn on a terminal, so it doesn't wrap
+#define TERMINAL_WIDTH 79
+
+static struct {
+  int bActive;
+  int bScanning;
+  int bTerminal;
+  int bStdoutTerminal; // so output there mixes with the status
+  uint64_t nsInterval;
+  uint64_t nsStart;
+  COUNTER nsNext; // when the status is due next
+  COUNTER cArchives, cbArchives; // found by the scan
+  COUNTER cArchivesDone;
+  COUNTER cbDone; // of cbArchives
+  COUNTER cbIn, cbOut;
+  // Only used while holding the drawing lock
+  char szLine[1024]; // last drawn
+  size_t cchShown;   // of it still on the terminal
+} progress;
+
+// Put cb into psz in a unit that fits
+static void FormatBytes(char *psz, size_t cb, uint64_t x) {
+  if (x >= (uint64_t)10 << 40)
+    snprintf(psz, cb, "%.1f TB", x / 1099511627776.0);
+  else if (x >= (uint64_t)10 << 30)
+    snprintf(psz, cb, "%.1f GB", x / 1073741824.0);
+  else
+    snprintf(psz, cb, "%.1f MB", x / 1048576.0);
+}
+
+static void FormatTime(char *psz, size_t cb, uint64_t ns) {
+  uint64_t s = ns / 1000000000;
+
+  snprintf(psz, cb, "%" PRIu64 ":%02d:%02d", s / 3600, (int)(s / 60 % 60),
+           (int)(s % 60));
+}
+
+// Bytes per nanosecond in MB/s
+static double Rate(uint64_t cb, uint64_t ns) {
+  return ns ? cb * 1e9 / ns / 1048576 : 0;
+}
+
+// Take the drawing lock. Drawing only takes microseconds, so spinning is
+// fine.
+static void Lock(void) {
+  while (!TryLock()) {
+#ifdef HAVE_PTHREAD
+    sched_yield();
+#endif
+  }
+}
+
+// Remove the status line from the terminal
+static void Erase(void) {
+  if (progress.cchShown) {
+    fprintf(stderr, "\r%*s\r", (int)progress.cchShown, "");
+    fflush(stderr);
+    progress.cchShown = 0;
+  }
+}
+
+static void Show(void) {
+  size_t cch = strlen(progress.szLine);
+
+  if (progress.bTerminal) {
+    // Overwrite in place, padded to cover what was there
+    if (cch < progress.cchShown)
+      cch = progress.cchShown;
+    fprintf(stderr, "\r%-*s", (int)cch, progress.szLine);
+    progress.cchShown = cch;
+  } else {
+    fprintf(stderr, "%s\n", progress.szLine);
+  }
+  fflush(stderr);
+}
+
+// Make up the status line. Must hold the drawing lock.
+static void Draw(uint64_t now, const char *pszArchive,
+                 const char *pszMember) {
+  char szLine[1024], szTotal[32], szEta[32];
+  uint64_t ns = now - progress.nsStart;
+  uint64_t cbArchives = CounterGet(progress.cbArchives);
+  uint64_t cbDone = CounterGet(progress.cbDone);
+  int n;
+
+  FormatBytes(szTotal, sizeof(szTotal), cbArchives);
+  if (progress.bScanning) {
+    n = snprintf(szLine, sizeof(szLine), "Scanning, %" PRIu64
+                 " archives with %s so far",
+                 (uint64_t)CounterGet(progress.cArchives), szTotal);
+  } else {
+    if (cbDone && cbDone < cbArchives)
+      FormatTime(szEta, sizeof(szEta),
+                 (uint64_t)((double)ns * (cbArchives - cbDone) / cbDone));
+    else
+      strcpy(szEta, "?");
+
+    n = snprintf(
+        szLine, sizeof(szLine),
+        "%" PRIu64 "/%" PRIu64 " archives, %d%% of %s, in %.1f MB/s, "
+        "out %.1f MB/s, ETA %s",
+        (uint64_t)CounterGet(progress.cArchivesDone),
+        (uint64_t)CounterGet(progress.cArchives),
+        cbArchives ? (int)(cbDone * 100.0 / cbArchives) : 100, szTotal,
+        Rate(CounterGet(progress.cbIn), ns),
+        Rate(CounterGet(progress.cbOut), ns), szEta);
+    if (pszArchive && n > 0 && (size_t)n < sizeof(szLine))
+      snprintf(szLine + n, sizeof(szLine) - n, ", %s%s%s", pszArchive,
+                    pszMember ? ": " : "", pszMember ? pszMember : "");
+  }
+
+  // Anything past the terminal's width would break redrawing in place
+  if (progress.bTerminal)
+    szLine[TERMINAL_WIDTH] = 0;
+  snprintf(progress.szLine, sizeof(progress.szLine), "%s", szLine);
+  Show();
+}
+
+// Draw the status if it is due and nobody else is drawing
+static void Tick(const char *pszArchive, const char *pszMember) {
+  uint64_t now;
+
+  if (!progress.bActive)
+    return;
+  now = StatsClock();
+  if (now < CounterGet(progress.nsNext) || !TryLock())
+    return;
+  if (now >= CounterGet(progress.nsNext)) {
+    Draw(now, pszArchive, pszMember);
+    CounterSet(progress.nsNext, now + progress.nsInterval);
+  }
+  Unlock();
+}
+
+// Start showing progress every iSeconds (0 for the default), beginning
+// with the scan for archives
+void ProgressStart(int iSeconds) {
+  progress.bTerminal = isatty(fileno(stderr));
+  progress.bStdoutTerminal = isatty(fileno(stdout));
+  if (iSeconds)
+    progress.nsInterval = (uint64_t)iSeconds * 1000000000;
+  else
+    progress.nsInterval = (uint64_t)(progress.bTerminal ? 1 : 10) *
+                          1000000000;
+  progress.nsStart = StatsClock();
+  CounterSet(progress.nsNext, progress.nsStart + progress.nsInterval);
+  progress.bScanning = 1;
+  progress.bActive = 1;
+}
+
+// Account an archive found by the scan
+void ProgressAddArchive(uint64_t cbArchive) {
+  CounterAdd(progress.cArchives, 1);
+  CounterAdd(progress.cbArchives, cbArchive);
+  Tick(NULL, NULL);
+}
+
+// The scan is done, processing starts now
+void ProgressRun(void) {
+  Lock();
+  progress.bScanning = 0;
+  progress.nsStart = StatsClock();
+  CounterSet(progress.nsNext, progress.nsStart + progress.nsInterval);
+  Unlock();
+}
+
+// Replace the status line with a summary of the run
+void ProgressEnd(void) {
+  char szDone[32], szTime[32];
+  uint64_t ns;
+
+  if (!progress.bActive)
+    return;
+  Lock();
+  progress.bActive = 0;
+  Erase();
+  ns = StatsClock() - progress.nsStart;
+  FormatBytes(szDone, sizeof(szDone), CounterGet(progress.cbDone));
+  FormatTime(szTime, sizeof(szTime), ns);
+  fprintf(stderr,
+          "Processed %" PRIu64 " archives with %s in %s, in %.1f MB/s, "
+          "out %.1f MB/s\n",
+          (uint64_t)CounterGet(progress.cArchivesDone), szDone, szTime,
+          Rate(CounterGet(progress.cbIn), ns),
+          Rate(CounterGet(progress.cbOut), ns));
+  fflush(stderr);
+  Unlock();
+}
+
+void ProgressJobStart(PROGRESSJOB *pj, uint64_t cbArchive) {
+  if (!pj)
+    return;
+  pj->cbArchive = cbArchive;
+  pj->cbIn = 0;
+  pj->cbOut = 0;
+}
+
+// The archive has been read up to cbIn bytes and cbOut bytes have been
+// written for it
+void ProgressJobUpdate(PROGRESSJOB *pj, const char *pszArchive,
+                       const char *pszMember, uint64_t cbIn, uint64_t cbOut) {
+  if (!pj)
+    return;
+
+  if (cbIn > pj->cbIn) {
+    CounterAdd(progress.cbIn, cbIn - pj->cbIn);
+    // Up to the size the scan saw, in case the archive changed since
+    if (pj->cbIn < pj->cbArchive)
+      CounterAdd(progress.cbDone, (cbIn < pj->cbArchive ? cbIn
+                                                        : pj->cbArchive) -
+                                      pj->cbIn);
+    pj->cbIn = cbIn;
+  }
+  if (cbOut > pj->cbOut) {
+    CounterAdd(progress.cbOut, cbOut - pj->cbOut);
+    pj->cbOut = cbOut;
+  }
+
+  Tick(pszArchive, pszMember);
+}
+
+// The archive is done, whatever of it wasn't read counts as done too
+void ProgressJobEnd(PROGRESSJOB *pj, const char *pszArchive) {
+  if (!pj)
+    return;
+
+  if (pj->cbIn < pj->cbArchive)
+    CounterAdd(progress.cbDone, pj->cbArchive - pj->cbIn);
+  CounterAdd(progress.cArchivesDone, 1);
+
+  Tick(pszArchive, NULL);
+}
+
+// On a terminal only output to it matters. Otherwise both go to files,
+// which may be the same one.
+int ProgressActive(FILE *f) {
+  if (progress.bTerminal)
+    return progress.bActive && (f == stderr || progress.bStdoutTerminal);
+  return progress.bActive;
+}
+
+// Keep the status off the screen while writing something else
+void ProgressPause(void) {
+  Lock();
+  Erase();
+}
+
+void ProgressResume(void) {
+  if (progress.bTerminal && progress.szLine[0])
+    Show();
+  Unlock();
+}
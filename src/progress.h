@@ -0,0 +1,52 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#ifndef PROGRESS_DOT_H
+#define PROGRESS_DOT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Progress of the whole run for -u: archives and bytes done out of what
+// a scan up front found, throughput and an estimate of the time left.
+// Workers add to counters without taking locks. Whichever thread finds
+// the status due draws it on stderr, as a line redrawn in place on a
+// terminal and as a line of its own every so often otherwise.
+
+// What a worker did on the archive it's processing so far
+typedef struct _PROGRESSJOB {
+  uint64_t cbArchive; // its size, as counted by the scan
+  uint64_t cbIn;      // source bytes accounted
+  uint64_t cbOut;     // output bytes accounted
+} PROGRESSJOB;
+
+void ProgressStart(int iSeconds);
+void ProgressAddArchive(uint64_t cbArchive);
+void ProgressRun(void);
+void ProgressEnd(void);
+
+// These do nothing if pj is NULL
+void ProgressJobStart(PROGRESSJOB *pj, uint64_t cbArchive);
+void ProgressJobUpdate(PROGRESSJOB *pj, const char *pszArchive,
+                       const char *pszMember, uint64_t cbIn, uint64_t cbOut);
+void ProgressJobEnd(PROGRESSJOB *pj, const char *pszArchive);
+
+// Whether writing to f gets in the way of the status, so logging has to
+// write around it
+int ProgressActive(FILE *f);
+void ProgressPause(void);
+void ProgressResume(void);
+
+#endif
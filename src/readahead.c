@@ -0,0 +1,293 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "global.h"
+#include "mapfile.h"
+#include "readahead.h"
+
+// Inflate members on a separate thread into a ring of buffers, so the
+// caller only has to deflate and write. The reader moves on to the next
+// member as soon as one is exhausted. Data, read errors and the result of
+// unzCloseCurrentFile are passed on exactly as the caller would have
+// seen them from minizip.
+
+#ifdef HAVE_PTHREAD
+
+#define RING_SLOTS 8
+#define RING_CHUNK (64 * 1024)
+
+// Chunk types
+#define CHUNK_DATA 0  // iValue bytes of data
+#define CHUNK_ERROR 1 // unzReadCurrentFile returned iValue < 0
+#define CHUNK_END 2   // unzCloseCurrentFile returned iValue
+
+typedef struct _CHUNK {
+  unsigned char *pData;
+  int iIndex;
+  int iType;
+  int iValue;
+} CHUNK;
+
+struct _READAHEAD {
+  char *pszZipFileName;
+  unz64_file_pos *Positions;
+  int iCount;
+  ZPOS64_T cMinSize;
+  CHUNK Ring[RING_SLOTS];
+  int iHead, cFilled;
+  int bHeld;     // caller still uses the head chunk
+  int bFinished; // reader has nothing more to add
+  int bStop;
+  int bThread;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+// Get a free slot, or NULL when stopped. Called with the lock held.
+static CHUNK *NextFreeChunk(READAHEAD *ra) {
+  while (!ra->bStop && ra->cFilled == RING_SLOTS)
+    pthread_cond_wait(&ra->cond, &ra->lock);
+  return ra->bStop ? NULL
+                   : &ra->Ring[(ra->iHead + ra->cFilled) % RING_SLOTS];
+}
+
+static void *ReadAheadThread(void *arg) {
+  READAHEAD *ra = arg;
+  unzFile UnZipHandle = MapFileUnzOpen(ra->pszZipFileName);
+  unz_file_info64 ZipInfo;
+  CHUNK *chunk;
+  int i, iType = CHUNK_DATA, iValue;
+
+  for (i = 0; UnZipHandle && i < ra->iCount; i++) {
+    // Members which aren't found or are too small are left to the caller
+    if (unzGoToFilePos64(UnZipHandle, &ra->Positions[i]) != UNZ_OK ||
+        unzGetCurrentFileInfo64(UnZipHandle, &ZipInfo, NULL, 0, NULL, 0, NULL,
+                                0) != UNZ_OK ||
+        ZipInfo.uncompressed_size < ra->cMinSize ||
+        unzOpenCurrentFile(UnZipHandle) != UNZ_OK)
+      continue;
+
+    do {
+      pthread_mutex_lock(&ra->lock);
+      chunk = NextFreeChunk(ra);
+      pthread_mutex_unlock(&ra->lock);
+      if (!chunk)
+        break;
+
+      iValue = unzReadCurrentFile(UnZipHandle, chunk->pData, RING_CHUNK);
+      if (iValue > 0)
+        iType = CHUNK_DATA;
+      else if (iValue < 0)
+        iType = CHUNK_ERROR;
+      else {
+        iType = CHUNK_END;
+        iValue = unzCloseCurrentFile(UnZipHandle);
+      }
+
+      pthread_mutex_lock(&ra->lock);
+      chunk->iIndex = i;
+      chunk->iType = iType;
+      chunk->iValue = iValue;
+      ra->cFilled++;
+      pthread_cond_broadcast(&ra->cond);
+      pthread_mutex_unlock(&ra->lock);
+    } while (iType == CHUNK_DATA);
+
+    if (iType != CHUNK_END)
+      unzCloseCurrentFile(UnZipHandle);
+    if (!chunk || iType == CHUNK_ERROR)
+      break;
+  }
+
+  if (UnZipHandle)
+    unzClose(UnZipHandle);
+
+  pthread_mutex_lock(&ra->lock);
+  ra->bFinished = 1;
+  pthread_cond_broadcast(&ra->cond);
+  pthread_mutex_unlock(&ra->lock);
+
+  return NULL;
+}
+
+// Drop the head chunk. Called with the lock held.
+static void PopChunk(READAHEAD *ra) {
+  ra->iHead = (ra->iHead + 1) % RING_SLOTS;
+  ra->cFilled--;
+  ra->bHeld = 0;
+  pthread_cond_broadcast(&ra->cond);
+}
+
+// Wait for a chunk. Returns NULL when the reader has finished.
+// Called with the lock held.
+static CHUNK *HeadChunk(READAHEAD *ra) {
+  if (ra->bHeld)
+    PopChunk(ra);
+  while (!ra->cFilled && !ra->bFinished)
+    pthread_cond_wait(&ra->cond, &ra->lock);
+  return ra->cFilled ? &ra->Ring[ra->iHead] : NULL;
+}
+
+// Start reading the iCount members listed in Entries (in the order
+// they will be requested) which are at least cMinSize bytes.
+// Returns NULL if there are none, or no thread could be started.
+READAHEAD *ReadAheadStart(const char *pszZipFileName, const ZIPENTRY *Entries,
+                          int iCount, ZPOS64_T cMinSize) {
+  READAHEAD *ra;
+  int i, bOk;
+
+  for (i = 0; i < iCount && Entries[i].cUncompressed < cMinSize; i++)
+    ;
+  if (i == iCount || !(ra = calloc(1, sizeof(READAHEAD))))
+    return NULL;
+
+  ra->iCount = iCount;
+  ra->cMinSize = cMinSize;
+  ra->pszZipFileName = strdup(pszZipFileName);
+  ra->Positions = calloc(iCount ? iCount : 1, sizeof(unz64_file_pos));
+  bOk = ra->pszZipFileName && ra->Positions;
+
+  for (i = 0; bOk && i < iCount; i++)
+    ra->Positions[i] = Entries[i].pos;
+  for (i = 0; bOk && i < RING_SLOTS; i++)
+    bOk = (ra->Ring[i].pData = malloc(RING_CHUNK)) != NULL;
+
+  if (bOk) {
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->cond, NULL);
+    ra->bThread = !pthread_create(&ra->thread, NULL, ReadAheadThread, ra);
+    if (!ra->bThread) {
+      pthread_cond_destroy(&ra->cond);
+      pthread_mutex_destroy(&ra->lock);
+      bOk = 0;
+    }
+  }
+
+  if (!bOk) {
+    ReadAheadStop(ra);
+    return NULL;
+  }
+
+  return ra;
+}
+
+// Check whether member iIndex is being read ahead. If so, its data has
+// to be taken with ReadAheadRead and ReadAheadClose.
+int ReadAheadOpen(READAHEAD *ra, int iIndex) {
+  CHUNK *chunk;
+
+  pthread_mutex_lock(&ra->lock);
+  // Skip whatever is left of members the caller didn't use
+  while ((chunk = HeadChunk(ra)) && chunk->iIndex < iIndex)
+    PopChunk(ra);
+  pthread_mutex_unlock(&ra->lock);
+
+  return chunk && chunk->iIndex == iIndex;
+}
+
+// Like unzReadCurrentFile, but *ppData is set to the data, which is valid
+// until the next call.
+int ReadAheadRead(READAHEAD *ra, const void **ppData) {
+  CHUNK *chunk;
+  int rc;
+
+  pthread_mutex_lock(&ra->lock);
+  chunk = HeadChunk(ra);
+  if (chunk->iType == CHUNK_END) {
+    rc = 0;
+  } else {
+    ra->bHeld = 1;
+    *ppData = chunk->pData;
+    rc = chunk->iValue;
+  }
+  pthread_mutex_unlock(&ra->lock);
+
+  return rc;
+}
+
+// Result of unzCloseCurrentFile for the member, after ReadAheadRead
+// returned 0
+int ReadAheadClose(READAHEAD *ra) {
+  CHUNK *chunk;
+  int rc;
+
+  pthread_mutex_lock(&ra->lock);
+  chunk = HeadChunk(ra);
+  rc = chunk->iValue;
+  PopChunk(ra);
+  pthread_mutex_unlock(&ra->lock);
+
+  return rc;
+}
+
+void ReadAheadStop(READAHEAD *ra) {
+  int i;
+
+  if (ra->bThread) {
+    pthread_mutex_lock(&ra->lock);
+    ra->bStop = 1;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+    pthread_join(ra->thread, NULL);
+    pthread_cond_destroy(&ra->cond);
+    pthread_mutex_destroy(&ra->lock);
+  }
+
+  for (i = 0; i < RING_SLOTS; i++)
+    free(ra->Ring[i].pData);
+  free(ra->Positions);
+  free(ra->pszZipFileName);
+  free(ra);
+}
+
+#else // !HAVE_PTHREAD
+
+READAHEAD *ReadAheadStart(const char *pszZipFileName, const ZIPENTRY *Entries,
+                          int iCount, ZPOS64_T cMinSize) {
+  (void)pszZipFileName;
+  (void)Entries;
+  (void)iCount;
+  (void)cMinSize;
+  return NULL;
+}
+
+int ReadAheadOpen(READAHEAD *ra, int iIndex) {
+  (void)ra;
+  (void)iIndex;
+  return 0;
+}
+
+int ReadAheadRead(READAHEAD *ra, const void **ppData) {
+  (void)ra;
+  (void)ppData;
+  return UNZ_INTERNALERROR;
+}
+
+int ReadAheadClose(READAHEAD *ra) {
+  (void)ra;
+  return UNZ_INTERNALERROR;
+}
+
+void ReadAheadStop(READAHEAD *ra) { (void)ra; }
+
+#endif
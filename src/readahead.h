@@ -0,0 +1,33 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#ifndef READAHEAD_DOT_H
+#define READAHEAD_DOT_H
+
+#include "global.h"
+
+// Without member threads, only members this big are worth a thread
+#define READAHEAD_MIN_SIZE (1024 * 1024)
+
+typedef struct _READAHEAD READAHEAD;
+
+READAHEAD *ReadAheadStart(const char *pszZipFileName, const ZIPENTRY *Entries,
+                          int iCount, ZPOS64_T cMinSize);
+int ReadAheadOpen(READAHEAD *ra, int iIndex);
+int ReadAheadRead(READAHEAD *ra, const void **ppData);
+int ReadAheadClose(READAHEAD *ra);
+void ReadAheadStop(READAHEAD *ra);
+
+#endif
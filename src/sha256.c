@@ -0,0 +1,130 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#include <string.h>
+
+#include "sha256.h"
+
+// Plain FIPS 180-4 SHA-256
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void Transform(uint32_t state[8], const unsigned char *p) {
+  uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  for (i = 0; i < 16; i++)
+    w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+           (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+  for (; i < 64; i++)
+    w[i] = w[i - 16] +
+           (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+           w[i - 7] +
+           (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+  f = state[5];
+  g = state[6];
+  h = state[7];
+
+  for (i = 0; i < 64; i++) {
+    t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) +
+         K[i] + w[i];
+    t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+void Sha256Init(SHA256 *ctx) {
+  static const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                   0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                   0x1f83d9ab, 0x5be0cd19};
+
+  memcpy(ctx->state, init, sizeof(init));
+  ctx->cbTotal = 0;
+}
+
+void Sha256Update(SHA256 *ctx, const void *pData, size_t cbData) {
+  const unsigned char *p = pData;
+  size_t cbUsed = ctx->cbTotal % 64;
+  size_t cb;
+
+  ctx->cbTotal += cbData;
+
+  if (cbUsed) {
+    cb = 64 - cbUsed < cbData ? 64 - cbUsed : cbData;
+    memcpy(ctx->block + cbUsed, p, cb);
+    p += cb;
+    cbData -= cb;
+    if (cbUsed + cb < 64)
+      return;
+    Transform(ctx->state, ctx->block);
+  }
+
+  for (; cbData >= 64; p += 64, cbData -= 64)
+    Transform(ctx->state, p);
+
+  memcpy(ctx->block, p, cbData);
+}
+
+void Sha256Final(SHA256 *ctx, unsigned char digest[SHA256_SIZE]) {
+  static const unsigned char pad[64] = {0x80};
+  unsigned char len[8];
+  uint64_t cBits = ctx->cbTotal * 8;
+  size_t cbUsed = ctx->cbTotal % 64;
+  int i;
+
+  for (i = 0; i < 8; i++)
+    len[i] = (unsigned char)(cBits >> (56 - 8 * i));
+
+  Sha256Update(ctx, pad, cbUsed < 56 ? 56 - cbUsed : 120 - cbUsed);
+  Sha256Update(ctx, len, sizeof(len));
+
+  for (i = 0; i < 32; i++)
+    digest[i] = (unsigned char)(ctx->state[i / 4] >> (24 - 8 * (i % 4)));
+}
@@ -0,0 +1,34 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SHA256_DOT_H
+#define SHA256_DOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32
+
+typedef struct _SHA256 {
+  uint32_t state[8];
+  uint64_t cbTotal;
+  unsigned char block[64];
+} SHA256;
+
+void Sha256Init(SHA256 *ctx);
+void Sha256Update(SHA256 *ctx, const void *pData, size_t cbData);
+void Sha256Final(SHA256 *ctx, unsigned char digest[SHA256_SIZE]);
+
+#endif
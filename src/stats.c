@@ -0,0 +1,382 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#ifdef __linux__
+#define _GNU_SOURCE // for RUSAGE_THREAD
+#endif
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <time.h>
+#endif
+#ifdef HAVE_GETRUSAGE
+#include <sys/resource.h>
+#endif
+
+#include "global.h"
+#include "stats.h"
+#include "util.h"
+
+// Column names, in the order of the values written for each archive
+static const char *PhaseNames[PHASE_COUNT] = {
+    "open",    "check", "list",  "sort",  "inflate",
+    "deflate", "write", "rename", "other"};
+
+// An archive in the list of the slowest ones
+typedef struct _SLOWARCHIVE {
+  char *pszArchive;
+  ARCHIVESTATS as;
+} SLOWARCHIVE;
+
+struct _STATS {
+  FILE *f; // NULL if only the slowest archives are wanted
+  int bCsv;
+  ARCHIVESTATS Total;
+  uint64_t nsScan; // walking directories, not part of any archive
+  unsigned int cArchives;
+  SLOWARCHIVE *Slowest; // slowest first
+  int cSlowest;
+  int cSlowestMax;
+};
+
+uint64_t StatsClock(void) {
+#if defined(WIN32)
+  static LARGE_INTEGER Frequency;
+  LARGE_INTEGER Counter;
+
+  if (!Frequency.QuadPart)
+    QueryPerformanceFrequency(&Frequency);
+  QueryPerformanceCounter(&Counter);
+  return (uint64_t)(Counter.QuadPart / Frequency.QuadPart) * 1000000000 +
+         (uint64_t)(Counter.QuadPart % Frequency.QuadPart) * 1000000000 /
+             Frequency.QuadPart;
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000000000 + (uint64_t)tv.tv_usec * 1000;
+#endif
+}
+
+// Page faults of the calling thread, or of the process if that's all
+// there is
+static void GetFaults(long *pcMinor, long *pcMajor) {
+#ifdef HAVE_GETRUSAGE
+  struct rusage ru;
+
+#ifdef RUSAGE_THREAD
+  if (!getrusage(RUSAGE_THREAD, &ru)) {
+#else
+  if (!getrusage(RUSAGE_SELF, &ru)) {
+#endif
+    *pcMinor = ru.ru_minflt;
+    *pcMajor = ru.ru_majflt;
+    return;
+  }
+#endif
+  *pcMinor = *pcMajor = 0;
+}
+
+// Peak resident set size of the process in KB
+static long GetMaxRss(void) {
+#ifdef HAVE_GETRUSAGE
+  struct rusage ru;
+
+  if (!getrusage(RUSAGE_SELF, &ru))
+#ifdef MAC_OS_X
+    return ru.ru_maxrss / 1024; // in bytes there
+#else
+    return ru.ru_maxrss;
+#endif
+#endif
+  return 0;
+}
+
+// All of these do nothing if as is NULL, so callers can time phases
+// without checking whether anyone is interested.
+void StatsBegin(ARCHIVESTATS *as) {
+  long cMinor, cMajor;
+
+  if (!as)
+    return;
+  memset(as, 0, sizeof(ARCHIVESTATS));
+  // The counts at the start are subtracted, StatsEnd adds the ones then
+  GetFaults(&cMinor, &cMajor);
+  as->cMinorFaults = -cMinor;
+  as->cMajorFaults = -cMajor;
+  as->nsLap = StatsClock();
+}
+
+// Account the time since the last lap to iPhase
+void StatsLap(ARCHIVESTATS *as, int iPhase) {
+  uint64_t now;
+
+  if (!as)
+    return;
+  now = StatsClock();
+  as->nsPhase[iPhase] += now - as->nsLap;
+  as->nsLap = now;
+}
+
+void StatsEnd(ARCHIVESTATS *as) {
+  long cMinor, cMajor;
+  int i;
+
+  if (!as)
+    return;
+  StatsLap(as, PHASE_OTHER);
+
+  // TzWriter calls are lapped as deflating, but they write too
+  if (as->nsWriter > as->nsPhase[PHASE_DEFLATE])
+    as->nsWriter = as->nsPhase[PHASE_DEFLATE];
+  as->nsPhase[PHASE_DEFLATE] -= as->nsWriter;
+  as->nsPhase[PHASE_WRITE] += as->nsWriter;
+
+  for (i = 0; i < PHASE_COUNT; i++)
+    as->nsTotal += as->nsPhase[i];
+
+  GetFaults(&cMinor, &cMajor);
+  as->cMinorFaults += cMinor;
+  as->cMajorFaults += cMajor;
+  as->cbMaxRss = GetMaxRss();
+}
+
+// Write a field for CSV, quoted if needed
+static void PutCsvString(FILE *f, const char *psz) {
+  if (!strpbrk(psz, ",\"\r\n")) {
+    fputs(psz, f);
+    return;
+  }
+  fputc('"', f);
+  for (; *psz; psz++) {
+    if (*psz == '"')
+      fputc('"', f);
+    fputc(*psz, f);
+  }
+  fputc('"', f);
+}
+
+// Write a JSON string. Names which aren't UTF-8 go out as they are.
+static void PutJsonString(FILE *f, const char *psz) {
+  fputc('"', f);
+  for (; *psz; psz++) {
+    if (*psz == '"' || *psz == '\\')
+      fprintf(f, "\\%c", *psz);
+    else if ((unsigned char)*psz < 0x20)
+      fprintf(f, "\\u%04x", (unsigned char)*psz);
+    else
+      fputc(*psz, f);
+  }
+  fputc('"', f);
+}
+
+static void PutString(STATS *st, const char *pszName, const char *psz) {
+  if (st->bCsv) {
+    PutCsvString(st->f, psz);
+    fputc(',', st->f);
+  } else {
+    fprintf(st->f, "\"%s\":", pszName);
+    PutJsonString(st->f, psz);
+    fputc(',', st->f);
+  }
+}
+
+static void PutNumber(STATS *st, const char *pszPrefix, const char *pszName,
+                      uint64_t x, int bLast) {
+  if (st->bCsv)
+    fprintf(st->f, "%" PRIu64 "%s", x, bLast ? "\n" : ",");
+  else
+    fprintf(st->f, "\"%s%s\":%" PRIu64 "%s", pszPrefix, pszName, x,
+            bLast ? "}\n" : ",");
+}
+
+// Write one record, for an archive or the whole run
+static void PutRecord(STATS *st, const char *pszType, const char *pszArchive,
+                      const char *pszResult, const char *pszStatus,
+                      const ARCHIVESTATS *as, uint64_t nsScan) {
+  int i;
+
+  if (!st->bCsv)
+    fputc('{', st->f);
+  PutString(st, "type", pszType);
+  PutString(st, "archive", pszArchive);
+  PutString(st, "result", pszResult);
+  PutString(st, "status", pszStatus);
+  PutNumber(st, "", "members", as->cMembers, 0);
+  PutNumber(st, "", "compressed", as->cCompressed, 0);
+  PutNumber(st, "", "uncompressed", as->cUncompressed, 0);
+  PutNumber(st, "", "read", as->cbRead, 0);
+  PutNumber(st, "", "written", as->cbWritten, 0);
+  PutNumber(st, "ns_", "total", as->nsTotal, 0);
+  for (i = 0; i < PHASE_COUNT; i++)
+    PutNumber(st, "ns_", PhaseNames[i], as->nsPhase[i], 0);
+  PutNumber(st, "ns_", "scan", nsScan, 0);
+  PutNumber(st, "", "minflt", as->cMinorFaults, 0);
+  PutNumber(st, "", "majflt", as->cMajorFaults, 0);
+  PutNumber(st, "", "maxrss_kb", as->cbMaxRss, 1);
+}
+
+STATS *StatsCreate(const char *pszFile, int cSlowest) {
+  STATS *st = calloc(1, sizeof(STATS));
+  int i;
+
+  if (!st)
+    return NULL;
+
+  if (cSlowest &&
+      !(st->Slowest = calloc(cSlowest, sizeof(SLOWARCHIVE)))) {
+    free(st);
+    return NULL;
+  }
+  st->cSlowestMax = cSlowest;
+
+  if (pszFile) {
+    st->f = strcmp(pszFile, "-") ? fopen(pszFile, "w") : stdout;
+    if (!st->f) {
+      StatsFree(st);
+      return NULL;
+    }
+    st->bCsv = EndsWithCaseInsensitive(pszFile, ".csv");
+    if (st->bCsv) {
+      fputs("type,archive,result,status,members,compressed,uncompressed,"
+            "read,written,ns_total",
+            st->f);
+      for (i = 0; i < PHASE_COUNT; i++)
+        fprintf(st->f, ",ns_%s", PhaseNames[i]);
+      fputs(",ns_scan,minflt,majflt,maxrss_kb\n", st->f);
+    }
+  }
+
+  return st;
+}
+
+// Account an archive. The result says what was done with it, pszStatus
+// what it was found to be.
+int StatsAdd(STATS *st, const char *pszArchive, const char *pszResult,
+             const char *pszStatus, const ARCHIVESTATS *as) {
+  SLOWARCHIVE *sa;
+  char *psz;
+  int i;
+
+  if (st->f)
+    PutRecord(st, "archive", pszArchive, pszResult, pszStatus, as, 0);
+
+  st->cArchives++;
+  st->Total.cMembers += as->cMembers;
+  st->Total.cCompressed += as->cCompressed;
+  st->Total.cUncompressed += as->cUncompressed;
+  st->Total.cbRead += as->cbRead;
+  st->Total.cbWritten += as->cbWritten;
+  st->Total.nsTotal += as->nsTotal;
+  for (i = 0; i < PHASE_COUNT; i++)
+    st->Total.nsPhase[i] += as->nsPhase[i];
+  st->Total.cMinorFaults += as->cMinorFaults;
+  st->Total.cMajorFaults += as->cMajorFaults;
+
+  // Keep the slowest, slowest first
+  if (!st->cSlowestMax || !as->nsTotal ||
+      (st->cSlowest == st->cSlowestMax &&
+       as->nsTotal <= st->Slowest[st->cSlowest - 1].as.nsTotal))
+    return TZ_OK;
+
+  if (!(psz = strdup(pszArchive)))
+    return TZ_CRITICAL;
+  if (st->cSlowest == st->cSlowestMax)
+    free(st->Slowest[--st->cSlowest].pszArchive);
+  for (sa = &st->Slowest[st->cSlowest++];
+       sa > st->Slowest && sa[-1].as.nsTotal < as->nsTotal; sa--)
+    sa[0] = sa[-1];
+  sa->pszArchive = psz;
+  sa->as = *as;
+
+  return TZ_OK;
+}
+
+// Account time spent looking for archives
+void StatsAddScan(STATS *st, uint64_t ns) { st->nsScan += ns; }
+
+// Write the totals and close the file. Returns NULL on success, or the
+// reason it could not be written.
+const char *StatsClose(STATS *st) {
+  int err;
+
+  st->Total.cbMaxRss = GetMaxRss();
+  if (!st->f)
+    return NULL;
+
+  PutRecord(st, "total", "", "", "", &st->Total, st->nsScan);
+  err = ferror(st->f);
+  if (st->f == stdout ? fflush(st->f) : fclose(st->f))
+    err = 1;
+  st->f = NULL;
+
+  return err ? strerror(errno ? errno : EIO) : NULL;
+}
+
+// Show the slowest archives and the totals, times in milliseconds
+void StatsReport(STATS *st, FILE *f) {
+  int i, j;
+
+  if (!st->cSlowestMax)
+    return;
+
+  fprintf(f, "\nSlowest archives (ms):\n%9s", "total");
+  for (j = 0; j < PHASE_COUNT; j++)
+    fprintf(f, " %8s", PhaseNames[j]);
+  fprintf(f, "  archive\n");
+
+  for (i = -1; i < st->cSlowest; i++) {
+    const ARCHIVESTATS *as = i < 0 ? &st->Total : &st->Slowest[i].as;
+
+    fprintf(f, "%9.1f", as->nsTotal / 1e6);
+    for (j = 0; j < PHASE_COUNT; j++)
+      fprintf(f, " %8.1f", as->nsPhase[j] / 1e6);
+    if (i < 0)
+      fprintf(f, "  (all %u archive%s)\n", st->cArchives,
+              st->cArchives != 1 ? "s" : "");
+    else
+      fprintf(f, "  %s\n", st->Slowest[i].pszArchive);
+  }
+
+  fprintf(f,
+          "Directory scan %.1f ms. Read %" PRIu64 " bytes, wrote %" PRIu64
+          " bytes. Peak RSS %ld KB.\n",
+          st->nsScan / 1e6, st->Total.cbRead, st->Total.cbWritten,
+          st->Total.cbMaxRss);
+}
+
+void StatsFree(STATS *st) {
+  int i;
+
+  if (st->f && st->f != stdout)
+    fclose(st->f);
+  for (i = 0; i < st->cSlowest; i++)
+    free(st->Slowest[i].pszArchive);
+  free(st->Slowest);
+  free(st);
+}
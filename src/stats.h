@@ -0,0 +1,72 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#ifndef STATS_DOT_H
+#define STATS_DOT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Where the time processing an archive goes, for -i and -n
+enum {
+  PHASE_OPEN,    // opening it and reading the central directory
+  PHASE_CHECK,   // CheckZipStatus
+  PHASE_LIST,    // GetFileList
+  PHASE_SORT,    // sorting the members into canonical order
+  PHASE_INFLATE, // reading members, waiting for read ahead included
+  PHASE_DEFLATE, // compressing members and putting the new zip together
+  PHASE_WRITE,   // creating and writing the temporary file
+  PHASE_RENAME,  // UpdateFile
+  PHASE_OTHER,   // logging and everything else
+  PHASE_COUNT
+};
+
+// What processing one archive took. Phases are timed by laps, each one
+// counting the time since the previous one, so they add up to nsTotal.
+typedef struct _ARCHIVESTATS {
+  uint64_t nsLap; // end of the last lap
+  uint64_t nsPhase[PHASE_COUNT];
+  uint64_t nsTotal;
+  uint64_t nsWriter;  // spent writing inside TzWriter calls lapped as deflate
+  uint64_t cbRead;    // central directory and compressed member data
+  uint64_t cbWritten; // to the temporary file
+  uint64_t cCompressed, cUncompressed; // members of the source
+  unsigned int cMembers;
+  long cMinorFaults; // of the thread processing it, for memory allocated
+  long cMajorFaults;
+  long cbMaxRss; // of the whole process when done, in KB
+} ARCHIVESTATS;
+
+// Nanoseconds from a monotonic clock
+uint64_t StatsClock(void);
+
+void StatsBegin(ARCHIVESTATS *as);
+void StatsLap(ARCHIVESTATS *as, int iPhase);
+void StatsEnd(ARCHIVESTATS *as);
+
+// Collects the ARCHIVESTATS of a run, writes them to a file as JSON lines
+// (or CSV if its name ends in .csv, "-" is stdout) and keeps the slowest
+// archives
+typedef struct _STATS STATS;
+
+STATS *StatsCreate(const char *pszFile, int cSlowest);
+int StatsAdd(STATS *st, const char *pszArchive, const char *pszResult,
+             const char *pszStatus, const ARCHIVESTATS *as);
+void StatsAddScan(STATS *st, uint64_t ns);
+const char *StatsClose(STATS *st);
+void StatsReport(STATS *st, FILE *f);
+void StatsFree(STATS *st);
+
+#endif
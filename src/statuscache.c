@@ -0,0 +1,328 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "global.h"
+#include "statuscache.h"
+#include "util.h"
+
+// The cache file is a header followed by fixed size entries in host byte
+// order, so it can be read back with a few large freads. It's only meant
+// to be used on the machine that wrote it; anything else is ignored.
+
+#define CACHE_MAGIC "TZCACHE1"
+#define CACHE_BYTE_ORDER 0x01020304
+#define CACHE_READ_ENTRIES 4096
+#define CACHE_MIN_SLOTS 1024
+
+// Internal flags, kept clear of the CACHE_... ones
+#define ENTRY_USED 0x80000000u  // slot taken (possibly forgotten)
+#define ENTRY_VALID 0x40000000u // archive is TorrentZipped
+
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+#define MTIME_NSEC(st) ((st)->st_mtim.tv_nsec)
+#define CTIME_NSEC(st) ((st)->st_ctim.tv_nsec)
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+#define MTIME_NSEC(st) ((st)->st_mtimespec.tv_nsec)
+#define CTIME_NSEC(st) ((st)->st_ctimespec.tv_nsec)
+#else
+#define MTIME_NSEC(st) 0
+#define CTIME_NSEC(st) 0
+#endif
+
+typedef struct _CACHEHEADER {
+  char szMagic[8];     // CACHE_MAGIC, not NUL terminated
+  uint32_t iByteOrder; // CACHE_BYTE_ORDER as written by the host
+  uint32_t cbEntry;    // sizeof(CACHEENTRY)
+  uint64_t cEntries;
+} CACHEHEADER;
+
+typedef struct _CACHEENTRY {
+  uint64_t dev, ino;
+  uint64_t stamp; // Stamp() of size, mtime and ctime
+  uint32_t crc;   // CRC32 of the central directory
+  uint32_t flags;
+} CACHEENTRY;
+
+// Open addressing hash table on (dev, ino)
+struct _STATUSCACHE {
+  char *pszFile;
+  CACHEENTRY *Slots;
+  size_t iMask;  // number of slots - 1
+  size_t cUsed;  // slots taken, including forgotten ones
+  size_t cValid; // slots holding a TorrentZipped archive
+  int bDirty;
+};
+
+static uint64_t Mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+// Anything that changes when the archive is written shows up here
+static uint64_t Stamp(const struct stat *st) {
+  uint64_t stamp = Mix((uint64_t)st->st_size);
+
+  stamp = Mix(stamp ^ (uint64_t)st->st_mtime);
+  stamp = Mix(stamp ^ (uint64_t)MTIME_NSEC(st));
+  stamp = Mix(stamp ^ (uint64_t)st->st_ctime);
+  stamp = Mix(stamp ^ (uint64_t)CTIME_NSEC(st));
+  return stamp;
+}
+
+// Find the slot for (dev, ino), or the free slot where it would go
+static CACHEENTRY *FindSlot(STATUSCACHE *sc, uint64_t dev, uint64_t ino) {
+  size_t i = Mix(ino ^ Mix(dev)) & sc->iMask;
+
+  while (sc->Slots[i].flags &&
+         (sc->Slots[i].dev != dev || sc->Slots[i].ino != ino))
+    i = (i + 1) & sc->iMask;
+  return &sc->Slots[i];
+}
+
+// Make room for cEntries valid entries, dropping forgotten ones
+static int Reserve(STATUSCACHE *sc, size_t cEntries) {
+  CACHEENTRY *OldSlots = sc->Slots;
+  size_t i, cOldSlots = sc->Slots ? sc->iMask + 1 : 0;
+  size_t cSlots = CACHE_MIN_SLOTS;
+
+  if (cEntries < (sc->iMask + 1) / 2 && sc->cUsed < (sc->iMask + 1) / 2)
+    return TZ_OK;
+
+  while (cSlots / 2 <= cEntries)
+    cSlots *= 2;
+  if (!(sc->Slots = calloc(cSlots, sizeof(CACHEENTRY)))) {
+    sc->Slots = OldSlots;
+    return TZ_CRITICAL;
+  }
+  sc->iMask = cSlots - 1;
+  sc->cUsed = sc->cValid;
+
+  for (i = 0; i < cOldSlots; i++)
+    if (OldSlots[i].flags & ENTRY_VALID)
+      *FindSlot(sc, OldSlots[i].dev, OldSlots[i].ino) = OldSlots[i];
+  free(OldSlots);
+
+  return TZ_OK;
+}
+
+STATUSCACHE *StatusCacheCreate(const char *pszFile) {
+  STATUSCACHE *sc = calloc(1, sizeof(STATUSCACHE));
+
+  if (!sc)
+    return NULL;
+  if (!(sc->pszFile = strdup(pszFile)) || Reserve(sc, 0) != TZ_OK) {
+    StatusCacheFree(sc);
+    return NULL;
+  }
+  return sc;
+}
+
+// Read the cache file. A missing file is an empty cache. Returns TZ_ERR if
+// the file couldn't be used (the cache stays empty or partly filled).
+int StatusCacheLoad(STATUSCACHE *sc) {
+  CACHEHEADER header;
+  CACHEENTRY *Buf;
+  CACHEENTRY *pSlot;
+  uint64_t cLeft;
+  size_t i, cRead;
+  off_t cbFile;
+  int rc = TZ_OK;
+  FILE *f = fopen(sc->pszFile, "rb");
+
+  if (!f)
+    return errno == ENOENT ? TZ_OK : TZ_ERR;
+
+  if (fseeko64(f, 0, SEEK_END) || (cbFile = ftello64(f)) < 0 ||
+      fseeko64(f, 0, SEEK_SET) || fread(&header, sizeof(header), 1, f) != 1 ||
+      memcmp(header.szMagic, CACHE_MAGIC, sizeof(header.szMagic)) ||
+      header.iByteOrder != CACHE_BYTE_ORDER ||
+      header.cbEntry != sizeof(CACHEENTRY) ||
+      header.cEntries !=
+          (uint64_t)(cbFile - sizeof(header)) / sizeof(CACHEENTRY)) {
+    fclose(f);
+    return TZ_ERR;
+  }
+
+  if (Reserve(sc, sc->cValid + header.cEntries) != TZ_OK ||
+      !(Buf = malloc(CACHE_READ_ENTRIES * sizeof(CACHEENTRY)))) {
+    fclose(f);
+    return TZ_CRITICAL;
+  }
+
+  for (cLeft = header.cEntries; cLeft && rc == TZ_OK; cLeft -= cRead) {
+    cRead = cLeft < CACHE_READ_ENTRIES ? cLeft : CACHE_READ_ENTRIES;
+    if (fread(Buf, sizeof(CACHEENTRY), cRead, f) != cRead) {
+      rc = TZ_ERR;
+      break;
+    }
+    for (i = 0; i < cRead; i++) {
+      if (!(Buf[i].flags & ENTRY_VALID))
+        continue;
+      pSlot = FindSlot(sc, Buf[i].dev, Buf[i].ino);
+      if (!pSlot->flags) {
+        sc->cUsed++;
+        sc->cValid++;
+      }
+      *pSlot = Buf[i];
+    }
+  }
+
+  free(Buf);
+  fclose(f);
+
+  return rc;
+}
+
+// Write the cache back if anything changed. Returns NULL on success, else
+// the reason for the failure.
+const char *StatusCacheSave(STATUSCACHE *sc) {
+  CACHEHEADER header;
+  size_t i, len;
+  char *pszTmpFile;
+  const char *pErr = NULL;
+  FILE *f = NULL;
+  int fd;
+
+  if (!sc->bDirty)
+    return NULL;
+
+  len = strlen(sc->pszFile) + sizeof(".XXXXXX");
+  if (!(pszTmpFile = malloc(len)))
+    return "Error allocating memory!";
+  snprintf(pszTmpFile, len, "%s.XXXXXX", sc->pszFile);
+
+  if ((fd = mkstemp(pszTmpFile)) < 0) {
+    free(pszTmpFile);
+    return strerror(errno);
+  }
+  if (!(f = fdopen(fd, "wb"))) {
+    pErr = strerror(errno);
+    close(fd);
+  }
+
+  if (f) {
+    memcpy(header.szMagic, CACHE_MAGIC, sizeof(header.szMagic));
+    header.iByteOrder = CACHE_BYTE_ORDER;
+    header.cbEntry = sizeof(CACHEENTRY);
+    header.cEntries = sc->cValid;
+    if (fwrite(&header, sizeof(header), 1, f) != 1)
+      pErr = strerror(errno);
+
+    for (i = 0; !pErr && i <= sc->iMask; i++)
+      if ((sc->Slots[i].flags & ENTRY_VALID) &&
+          fwrite(&sc->Slots[i], sizeof(CACHEENTRY), 1, f) != 1)
+        pErr = strerror(errno);
+
+    if (fclose(f) && !pErr)
+      pErr = strerror(errno);
+  }
+
+  if (pErr)
+    remove(pszTmpFile);
+  else if (!(pErr = UpdateFile(sc->pszFile, pszTmpFile)))
+    sc->bDirty = 0;
+
+  free(pszTmpFile);
+
+  return pErr;
+}
+
+void StatusCacheFree(STATUSCACHE *sc) {
+  free(sc->Slots);
+  free(sc->pszFile);
+  free(sc);
+}
+
+// Check whether the archive was found to be TorrentZipped and hasn't
+// changed since. With CACHE_STRIPPED in iFlags, only archives checked with
+// sub-directories stripped count.
+int StatusCacheLookup(STATUSCACHE *sc, const struct stat *st,
+                      unsigned int iFlags) {
+  CACHEENTRY *pSlot;
+
+  // Some platforms (Windows) don't have inode numbers
+  if (!st->st_ino)
+    return 0;
+
+  pSlot = FindSlot(sc, (uint64_t)st->st_dev, (uint64_t)st->st_ino);
+
+  return (pSlot->flags & ENTRY_VALID) && pSlot->stamp == Stamp(st) &&
+         (pSlot->flags & iFlags) == iFlags;
+}
+
+// Remember the archive as TorrentZipped
+int StatusCacheSet(STATUSCACHE *sc, const struct stat *st, unsigned long crc,
+                   unsigned int iFlags) {
+  CACHEENTRY *pSlot;
+  uint64_t stamp = Stamp(st);
+
+  if (!st->st_ino)
+    return TZ_OK;
+
+  if (Reserve(sc, sc->cValid + 1) != TZ_OK)
+    return TZ_CRITICAL;
+
+  pSlot = FindSlot(sc, (uint64_t)st->st_dev, (uint64_t)st->st_ino);
+  if (!pSlot->flags)
+    sc->cUsed++;
+  if (!(pSlot->flags & ENTRY_VALID)) {
+    sc->cValid++;
+  } else if (pSlot->stamp == stamp && pSlot->crc == crc) {
+    // Still the same archive, so what it was checked for still holds
+    if ((pSlot->flags & iFlags) == iFlags)
+      return TZ_OK;
+    iFlags |= pSlot->flags;
+  }
+
+  pSlot->dev = (uint64_t)st->st_dev;
+  pSlot->ino = (uint64_t)st->st_ino;
+  pSlot->stamp = stamp;
+  pSlot->crc = (uint32_t)crc;
+  pSlot->flags = ENTRY_USED | ENTRY_VALID | iFlags;
+  sc->bDirty = 1;
+
+  return TZ_OK;
+}
+
+// Drop the archive, it isn't (or no longer) TorrentZipped
+void StatusCacheForget(STATUSCACHE *sc, const struct stat *st) {
+  CACHEENTRY *pSlot;
+
+  if (!st->st_ino)
+    return;
+
+  pSlot = FindSlot(sc, (uint64_t)st->st_dev, (uint64_t)st->st_ino);
+  if (pSlot->flags & ENTRY_VALID) {
+    pSlot->flags = ENTRY_USED;
+    sc->cValid--;
+    sc->bDirty = 1;
+  }
+}
@@ -0,0 +1,42 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#ifndef STATUSCACHE_DOT_H
+#define STATUSCACHE_DOT_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "global.h"
+
+// Flags stored with an archive
+#define CACHE_STRIPPED 1 // checked with sub-directories stripped (-d)
+
+// Remembers archives found to be TorrentZipped, so they can be skipped
+// as long as their inode, size, mtime and ctime stay the same.
+typedef struct _STATUSCACHE STATUSCACHE;
+
+STATUSCACHE *StatusCacheCreate(const char *pszFile);
+int StatusCacheLoad(STATUSCACHE *sc);
+const char *StatusCacheSave(STATUSCACHE *sc);
+void StatusCacheFree(STATUSCACHE *sc);
+
+int StatusCacheLookup(STATUSCACHE *sc, const struct stat *st,
+                      unsigned int iFlags);
+int StatusCacheSet(STATUSCACHE *sc, const struct stat *st, unsigned long crc,
+                   unsigned int iFlags);
+void StatusCacheForget(STATUSCACHE *sc, const struct stat *st);
+
+#endif
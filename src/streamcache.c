@@ -0,0 +1,451 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "crc32.h"
+#include "global.h"
+#include "streamcache.h"
+#include "util.h"
+
+// Every stream is a file named CRC-SIZE-SHA256.tzd (all in hex) holding
+// STREAM_MAGIC, the CRC32 of the compressed stream and the stream itself.
+// The file's mtime is its last use, so least recently used streams can be
+// evicted across runs. Before a stream is handed out, its CRC32 is checked.
+// The SHA-256 in the name was computed over the uncompressed data by
+// whoever stored it, so a lookup can't match a different file.
+
+#define STREAM_MAGIC "TZD1"
+#define STREAM_HEADER_SIZE 8
+#define STREAM_SUFFIX ".tzd"
+#define STREAM_NAME_LENGTH (8 + 1 + 16 + 1 + 2 * SHA256_SIZE + 4)
+#define STREAM_MIN_SLOTS 1024
+
+// Evicting goes down to this share of the limit, so it doesn't happen on
+// every new stream
+#define EVICT_PERCENT 90
+
+#define ENTRY_USED 1  // slot taken (possibly removed)
+#define ENTRY_VALID 2 // stream is in the cache
+
+typedef struct _STREAMENTRY {
+  uint64_t cUncompressed;
+  uint32_t crc;
+  uint32_t flags;
+  unsigned char digest[SHA256_SIZE];
+  uint64_t cbFile;
+  time_t tUsed;
+} STREAMENTRY;
+
+// Open addressing hash table on (crc, cUncompressed), so all streams for
+// the same CRC and size are found on one probe sequence
+struct _STREAMCACHE {
+  char *pszDir;
+  uint64_t cbMax;
+  uint64_t cbTotal;
+  STREAMENTRY *Slots;
+  size_t iMask;  // number of slots - 1
+  size_t cUsed;  // slots taken, including removed ones
+  size_t cValid; // streams in the cache
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t lock;
+#endif
+};
+
+static void Lock(STREAMCACHE *sc) {
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&sc->lock);
+#else
+  (void)sc;
+#endif
+}
+
+static void Unlock(STREAMCACHE *sc) {
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&sc->lock);
+#else
+  (void)sc;
+#endif
+}
+
+static size_t Hash(uint32_t crc, uint64_t cUncompressed) {
+  uint64_t x = cUncompressed * 0x9e3779b97f4a7c15ULL ^ crc;
+
+  x ^= x >> 31;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 29;
+  return (size_t)x;
+}
+
+// Path of the stream file for e into pszPath (MAX_PATH + 1 bytes)
+static void StreamPath(const STREAMCACHE *sc, const STREAMENTRY *e,
+                       char *pszPath) {
+  int i, n;
+
+  n = snprintf(pszPath, MAX_PATH + 1, "%s%c%08" PRIx32 "-%016" PRIx64 "-",
+               sc->pszDir, DIRSEP, e->crc, e->cUncompressed);
+  for (i = 0; i < SHA256_SIZE && n + 2 < MAX_PATH + 1; i++, n += 2)
+    snprintf(pszPath + n, 3, "%02x", e->digest[i]);
+  snprintf(pszPath + n, MAX_PATH + 1 - n, "%s", STREAM_SUFFIX);
+}
+
+// Parse a stream file name, returns 0 if it isn't one
+static int ParseStreamName(const char *pszName, STREAMENTRY *e) {
+  unsigned int b;
+  int i;
+
+  if (strlen(pszName) != STREAM_NAME_LENGTH ||
+      strcmp(pszName + STREAM_NAME_LENGTH - 4, STREAM_SUFFIX) ||
+      sscanf(pszName, "%8" SCNx32 "-%16" SCNx64 "-", &e->crc,
+             &e->cUncompressed) != 2)
+    return 0;
+
+  for (i = 0; i < SHA256_SIZE; i++) {
+    if (sscanf(pszName + 26 + 2 * i, "%2x", &b) != 1)
+      return 0;
+    e->digest[i] = (unsigned char)b;
+  }
+
+  return 1;
+}
+
+// Find the stream, or the free slot where it would go
+static STREAMENTRY *FindSlot(STREAMCACHE *sc, uint32_t crc,
+                             uint64_t cUncompressed,
+                             const unsigned char *digest) {
+  size_t i = Hash(crc, cUncompressed) & sc->iMask;
+
+  while (sc->Slots[i].flags &&
+         (!(sc->Slots[i].flags & ENTRY_VALID) || sc->Slots[i].crc != crc ||
+          sc->Slots[i].cUncompressed != cUncompressed ||
+          memcmp(sc->Slots[i].digest, digest, SHA256_SIZE)))
+    i = (i + 1) & sc->iMask;
+  return &sc->Slots[i];
+}
+
+// Make room for one more stream, dropping removed ones
+static int Reserve(STREAMCACHE *sc) {
+  STREAMENTRY *OldSlots = sc->Slots;
+  size_t i, cOldSlots = sc->Slots ? sc->iMask + 1 : 0;
+  size_t cSlots = STREAM_MIN_SLOTS;
+
+  if (sc->cUsed + 1 < cOldSlots / 2)
+    return TZ_OK;
+
+  while (cSlots / 2 <= sc->cValid + 1)
+    cSlots *= 2;
+  if (!(sc->Slots = calloc(cSlots, sizeof(STREAMENTRY)))) {
+    sc->Slots = OldSlots;
+    return TZ_CRITICAL;
+  }
+  sc->iMask = cSlots - 1;
+  sc->cUsed = sc->cValid;
+
+  for (i = 0; i < cOldSlots; i++)
+    if (OldSlots[i].flags & ENTRY_VALID)
+      *FindSlot(sc, OldSlots[i].crc, OldSlots[i].cUncompressed,
+                OldSlots[i].digest) = OldSlots[i];
+  free(OldSlots);
+
+  return TZ_OK;
+}
+
+// Add e to the index. Called with the lock held.
+static void Insert(STREAMCACHE *sc, const STREAMENTRY *e) {
+  STREAMENTRY *pSlot;
+
+  if (Reserve(sc) != TZ_OK)
+    return;
+
+  pSlot = FindSlot(sc, e->crc, e->cUncompressed, e->digest);
+  if (pSlot->flags & ENTRY_VALID)
+    return;
+
+  *pSlot = *e;
+  pSlot->flags = ENTRY_USED | ENTRY_VALID;
+  sc->cUsed++;
+  sc->cValid++;
+  sc->cbTotal += e->cbFile;
+}
+
+// Drop e from the index and delete its file. Called with the lock held.
+static void Remove(STREAMCACHE *sc, STREAMENTRY *pSlot) {
+  char szPath[MAX_PATH + 1];
+
+  StreamPath(sc, pSlot, szPath);
+  remove(szPath);
+  pSlot->flags = ENTRY_USED;
+  sc->cValid--;
+  sc->cbTotal -= pSlot->cbFile;
+}
+
+static int CompareUse(const void *p1, const void *p2) {
+  const STREAMENTRY *e1 = *(const STREAMENTRY *const *)p1;
+  const STREAMENTRY *e2 = *(const STREAMENTRY *const *)p2;
+
+  return e1->tUsed < e2->tUsed ? -1 : e1->tUsed > e2->tUsed;
+}
+
+// Remove least recently used streams until the cache fits its limit.
+// Called with the lock held.
+static void Evict(STREAMCACHE *sc) {
+  STREAMENTRY **Sorted;
+  size_t i, n = 0;
+
+  if (sc->cbTotal <= sc->cbMax)
+    return;
+  if (!(Sorted = malloc(sc->cValid * sizeof(STREAMENTRY *))))
+    return;
+
+  for (i = 0; i <= sc->iMask; i++)
+    if (sc->Slots[i].flags & ENTRY_VALID)
+      Sorted[n++] = &sc->Slots[i];
+  qsort(Sorted, n, sizeof(STREAMENTRY *), CompareUse);
+
+  for (i = 0; i < n && sc->cbTotal > sc->cbMax / 100 * EVICT_PERCENT; i++)
+    Remove(sc, Sorted[i]);
+
+  free(Sorted);
+}
+
+// Open (or create) the cache directory and index what is in there.
+// Returns NULL (with errno set) on failure.
+STREAMCACHE *StreamCacheOpen(const char *pszDir, ZPOS64_T cbMax) {
+  STREAMCACHE *sc = calloc(1, sizeof(STREAMCACHE));
+  char szPath[MAX_PATH + 1];
+  struct dirent *direntp;
+  struct stat st;
+  STREAMENTRY e;
+  DIR *dirp;
+
+  if (!sc)
+    return NULL;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init(&sc->lock, NULL);
+#endif
+  sc->cbMax = cbMax;
+  if (!(sc->pszDir = strdup(pszDir)) || Reserve(sc) != TZ_OK) {
+    StreamCacheClose(sc);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  // Leave room for the stream names and the temporary suffix
+  if (strlen(pszDir) + 1 + STREAM_NAME_LENGTH + 7 > MAX_PATH) {
+    StreamCacheClose(sc);
+    errno = ENAMETOOLONG;
+    return NULL;
+  }
+
+  dirp = opendir(pszDir);
+  if (!dirp && errno == ENOENT) {
+#ifdef _WIN32
+    if (!_mkdir(pszDir))
+#else
+    if (!mkdir(pszDir, 0777))
+#endif
+      dirp = opendir(pszDir);
+  }
+  if (!dirp) {
+    int err = errno;
+    StreamCacheClose(sc);
+    errno = err;
+    return NULL;
+  }
+
+  while ((direntp = readdir(dirp))) {
+    memset(&e, 0, sizeof(e));
+    if (!ParseStreamName(direntp->d_name, &e))
+      continue;
+    snprintf(szPath, sizeof(szPath), "%s%c%s", pszDir, DIRSEP,
+             direntp->d_name);
+    if (stat(szPath, &st) || !S_ISREG(st.st_mode))
+      continue;
+    e.cbFile = st.st_size;
+    e.tUsed = st.st_mtime;
+    Insert(sc, &e);
+  }
+  closedir(dirp);
+
+  Evict(sc);
+
+  return sc;
+}
+
+void StreamCacheClose(STREAMCACHE *sc) {
+#ifdef HAVE_PTHREAD
+  pthread_mutex_destroy(&sc->lock);
+#endif
+  free(sc->Slots);
+  free(sc->pszDir);
+  free(sc);
+}
+
+// Check whether there is any stream for data with this CRC32 and size,
+// i.e. whether it's worth computing the SHA-256
+int StreamCacheHas(STREAMCACHE *sc, uLong crc, ZPOS64_T cUncompressed) {
+  size_t i;
+  int bFound = 0;
+
+  Lock(sc);
+  for (i = Hash(crc, cUncompressed) & sc->iMask; sc->Slots[i].flags && !bFound;
+       i = (i + 1) & sc->iMask)
+    bFound = (sc->Slots[i].flags & ENTRY_VALID) && sc->Slots[i].crc == crc &&
+             sc->Slots[i].cUncompressed == cUncompressed;
+  Unlock(sc);
+
+  return bFound;
+}
+
+// Get a copy of the stream (to be freed by the caller), or NULL if there
+// is none. Streams failing the integrity check are removed.
+unsigned char *StreamCacheGet(STREAMCACHE *sc, uLong crc,
+                              ZPOS64_T cUncompressed,
+                              const unsigned char digest[SHA256_SIZE],
+                              size_t *pcbData) {
+  char szPath[MAX_PATH + 1];
+  unsigned char header[STREAM_HEADER_SIZE];
+  unsigned char *pData = NULL;
+  STREAMENTRY e, *pSlot;
+  size_t cbData = 0;
+  uLong crcStream;
+  FILE *f;
+  int bFound, bOk = 0;
+
+  Lock(sc);
+  pSlot = FindSlot(sc, (uint32_t)crc, cUncompressed, digest);
+  if ((bFound = pSlot->flags & ENTRY_VALID))
+    e = *pSlot;
+  Unlock(sc);
+
+  if (!bFound)
+    return NULL;
+
+  StreamPath(sc, &e, szPath);
+  if ((f = fopen(szPath, "rb"))) {
+    if (e.cbFile >= STREAM_HEADER_SIZE &&
+        e.cbFile - STREAM_HEADER_SIZE <= (uint64_t)(size_t)-1 &&
+        (pData = malloc((cbData = e.cbFile - STREAM_HEADER_SIZE) + 1)) &&
+        fread(header, 1, STREAM_HEADER_SIZE, f) == STREAM_HEADER_SIZE &&
+        fread(pData, 1, cbData + 1, f) == cbData &&
+        !memcmp(header, STREAM_MAGIC, 4)) {
+      crcStream = (uLong)header[4] | (uLong)header[5] << 8 |
+                  (uLong)header[6] << 16 | (uLong)header[7] << 24;
+      bOk = Crc32(0L, pData, cbData) == crcStream;
+    }
+    fclose(f);
+  }
+
+  Lock(sc);
+  pSlot = FindSlot(sc, (uint32_t)crc, cUncompressed, digest);
+  if (pSlot->flags & ENTRY_VALID) {
+    if (bOk)
+      pSlot->tUsed = time(NULL);
+    else
+      Remove(sc, pSlot);
+  }
+  Unlock(sc);
+
+  if (!bOk) {
+    free(pData);
+    return NULL;
+  }
+
+  // Remember the use for the next run's eviction
+  utime(szPath, NULL);
+
+  *pcbData = cbData;
+  return pData;
+}
+
+// Add a stream. Failures only mean the stream won't be cached.
+void StreamCachePut(STREAMCACHE *sc, uLong crc, ZPOS64_T cUncompressed,
+                    const unsigned char digest[SHA256_SIZE],
+                    const unsigned char *pData, size_t cbData) {
+  char szPath[MAX_PATH + 1];
+  char szTmpPath[MAX_PATH + 1 + 7]; // szPath and ".XXXXXX"
+  unsigned char header[STREAM_HEADER_SIZE];
+  uLong crcStream = Crc32(0L, pData, cbData);
+  STREAMENTRY e, *pSlot;
+  FILE *f;
+  int fd, bOk;
+
+  memset(&e, 0, sizeof(e));
+  e.crc = (uint32_t)crc;
+  e.cUncompressed = cUncompressed;
+  memcpy(e.digest, digest, SHA256_SIZE);
+  e.cbFile = STREAM_HEADER_SIZE + cbData;
+
+  Lock(sc);
+  pSlot = FindSlot(sc, e.crc, e.cUncompressed, e.digest);
+  bOk = !(pSlot->flags & ENTRY_VALID);
+  Unlock(sc);
+
+  // Some other archive already had it, or it would evict everything
+  if (!bOk || e.cbFile > sc->cbMax)
+    return;
+
+  memcpy(header, STREAM_MAGIC, 4);
+  header[4] = (unsigned char)crcStream;
+  header[5] = (unsigned char)(crcStream >> 8);
+  header[6] = (unsigned char)(crcStream >> 16);
+  header[7] = (unsigned char)(crcStream >> 24);
+
+  StreamPath(sc, &e, szPath);
+  snprintf(szTmpPath, sizeof(szTmpPath), "%s.XXXXXX", szPath);
+  if ((fd = mkstemp(szTmpPath)) < 0)
+    return;
+  if (!(f = fdopen(fd, "wb"))) {
+    close(fd);
+    remove(szTmpPath);
+    return;
+  }
+
+  bOk = fwrite(header, 1, STREAM_HEADER_SIZE, f) == STREAM_HEADER_SIZE &&
+        fwrite(pData, 1, cbData, f) == cbData;
+  if (fclose(f) || !bOk || UpdateFile(szPath, szTmpPath)) {
+    remove(szTmpPath);
+    return;
+  }
+
+  e.tUsed = time(NULL);
+  Lock(sc);
+  Insert(sc, &e);
+  Evict(sc);
+  Unlock(sc);
+}
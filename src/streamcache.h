@@ -0,0 +1,41 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#ifndef STREAMCACHE_DOT_H
+#define STREAMCACHE_DOT_H
+
+#include "global.h"
+#include "sha256.h"
+
+// Members smaller than this aren't worth a file in the cache
+#define STREAMCACHE_MIN_SIZE (16 * 1024)
+
+// A directory of TorrentZip deflate streams, keyed by CRC32, size and
+// SHA-256 of the uncompressed data. Safe to use from several threads.
+typedef struct _STREAMCACHE STREAMCACHE;
+
+STREAMCACHE *StreamCacheOpen(const char *pszDir, ZPOS64_T cbMax);
+void StreamCacheClose(STREAMCACHE *sc);
+
+int StreamCacheHas(STREAMCACHE *sc, uLong crc, ZPOS64_T cUncompressed);
+unsigned char *StreamCacheGet(STREAMCACHE *sc, uLong crc,
+                              ZPOS64_T cUncompressed,
+                              const unsigned char digest[SHA256_SIZE],
+                              size_t *pcbData);
+void StreamCachePut(STREAMCACHE *sc, uLong crc, ZPOS64_T cUncompressed,
+                    const unsigned char digest[SHA256_SIZE],
+                    const unsigned char *pData, size_t cbData);
+
+#endif
@@ -18,11 +18,10 @@
 #include "../config.h"
 #endif
 
-#include "minizip.h"
-
 #include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,11 +38,24 @@
 #include <io.h>
 #else
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
+#include "centraldir.h"
+#include "crc32.h"
+#include "decoder.h"
 #include "global.h"
 #include "logging.h"
+#include "mapfile.h"
+#include "member.h"
+#include "pool.h"
+#include "progress.h"
+#include "readahead.h"
+#include "stats.h"
+#include "statuscache.h"
+#include "streamcache.h"
+#include "tzwriter.h"
 #include "util.h"
 
 // The following macros may be missing on Windows
@@ -81,21 +93,27 @@
   -1                // Has proper comment, but zipfile has been changed.
 #define STATUS_OK 0 // File is A-Okay.
 
-WORKSPACE *AllocateWorkspace(void);
-void FreeWorkspace(WORKSPACE *ws);
-static int GetFileList(unzFile UnZipHandle, WORKSPACE *ws);
-int CheckZipStatus(unz64_s *UnzipStream, WORKSPACE *ws);
+static int GetFileList(const CENTRALDIR *cd, WORKSPACE *ws);
+int CheckZipStatus(MAPFILE *mf, const CENTRALDIR *cd, WORKSPACE *ws);
 int ShouldFileBeRemoved(int iArray, WORKSPACE *ws);
 int ZipHasDirEntry(WORKSPACE *ws);
 static int ZipHasSubdirs(WORKSPACE *ws);
 static int ZipHasWrongOrder(WORKSPACE *ws);
-int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
-               MIGRATE *mig);
-static char **GetDirFileList(DIR *dirp, int *piElements);
+int MigrateZip(const char *zip_path, const char *pDir, const char *pszOutPath,
+               WORKSPACE *ws, MIGRATE *mig);
+static int MigrateJob(void *arg, WORKSPACE *ws);
+static int RetireMigrateJob(void *arg, int rc);
 static int RecursiveMigrate(const char *pszRelPath, const struct stat *pstat,
                             WORKSPACE *ws, MIGRATE *mig);
-int RecursiveMigrateDir(const char *pszRelPath, WORKSPACE *ws);
+static int WalkMigrateDir(const char *pszRelPath, WORKSPACE *ws, int bCount);
 int RecursiveMigrateTop(const char *pszRelPath, WORKSPACE *ws);
+static int CountArchives(const char *pszRelPath, WORKSPACE *ws);
+static MIGRATE *BeginMigrateSummary(WORKSPACE *ws);
+static int EndMigrateSummary(MIGRATE *mig, int rc);
+static int RetireMigrateSummary(void *arg, int rc);
+static void AddExecTime(MIGRATE *mig);
+static const char *StatusName(int iStatus);
+static const char *ResultName(int rc, int bCached);
 void DisplayMigrateSummary(WORKSPACE *ws, MIGRATE *mig);
 
 // The created zip file global comment used to identify files
@@ -104,15 +122,108 @@ static const char *gszApp = {"TORRENTZIPPED-"};
 
 // The global flags that can be set with commandline parms.
 // Setup here so as to avoid having to pass them to a lot of functions.
+char qCheckOnly = 0;
 char qForceReZip = 0;
 char qGUILaunch = 0;
 char qNoRecursion = 0;
 char qQuietMode = 0;
+char qRevalidate = 0;
 char qStripSubdirs = 0;
+int iMemberThreads = 1;
+char qProgress = 0;
+ZPOS64_T cbMemZip = 8 << 20; // largest zip built in memory (-w)
 
 // Global flag to determine if any zipfile errors were detected
 char qErrors = 0;
 
+// Archives known to be TorrentZipped (-k), only used on the main thread
+static STATUSCACHE *StatusCache;
+
+// Deflate streams of members seen before (-z), shared by all threads
+static STREAMCACHE *StreamCache;
+
+// Timings and sizes of the archives processed (-i and -n), only used on
+// the main thread. Workers just check whether it's there.
+static STATS *Stats;
+
+// Directory to mirror the processed tree into instead of rezipping in
+// place (-o), and where to put temporary files (-t)
+static const char *pszOutDir;
+static const char *pszTmpDir;
+
+// Leading part of the paths found by the walker that isn't mirrored
+static int iOutPrefix;
+
+// The directories of -o and -t, which the walker skips so runs don't
+// process their own output
+static struct stat OwnDirs[2];
+static int cOwnDirs;
+
+// Time at which the last archive or directory was retired. Execution time
+// is accounted to whatever gets retired next.
+static time_t LastRetireTime;
+
+#if defined(HAVE_OPENAT) && defined(HAVE_FSTATAT) && defined(HAVE_FDOPENDIR)
+#define WALK_AT // look at directory entries relative to their directory
+#endif
+
+// Types of directory entries, as far as readdir knows
+#define WALK_UNKNOWN 0
+#define WALK_FILE 1
+#define WALK_DIR 2
+
+// A directory entry the walker still has to look at
+typedef struct _WALKENTRY {
+  char *pszName; // these must come first, so WALKENTRY works as SORTNAME
+  const char *pszKey;
+  size_t iBase;
+  uint64_t Prefix;
+  size_t iName; // offset of the name in Names while reading
+  int iType;     // WALK_...
+} WALKENTRY;
+
+// A directory being walked
+typedef struct _WALKDIR {
+  MIGRATE *mig;
+  DIR *dirp; // kept open for the *at() calls
+  WALKENTRY *Entries;
+  STRINGTABLE Names;
+  int cEntries;
+  int iNext;
+  size_t cchPath; // of its path in pszPath, including the DIRSEP
+} WALKDIR;
+
+// The stack of directories from the top one down to the current one
+typedef struct _WALK {
+  WALKDIR *Dirs;
+  int cDirs;
+  int cAlloc;
+  char *pszPath; // of the current entry
+  size_t cbPath;
+  int bCount; // only count the archives for -u, quietly
+} WALK;
+
+// An archive handed to the worker pool
+typedef struct _MIGRATEJOB {
+  MIGRATE *mig;
+  struct stat st;    // as seen by the walker, or after rezipping
+  unsigned long crc; // CRC32 of the central directory if TorrentZipped
+  int iStatus;       // STATUS_... found by MigrateZip
+  int bCached;       // skipped because of the status cache
+  int iOutPos;       // start of the part of szRelPath mirrored by -o
+  ARCHIVESTATS Stats;
+  PROGRESSJOB Progress;
+  char szRelPath[1];
+} MIGRATEJOB;
+
+// Directory (or command line argument) statistics, shown once everything
+// submitted for it has been retired
+typedef struct _MIGRATESUMMARY {
+  MIGRATE mig;
+  WORKSPACE *ws;
+  int rc;
+} MIGRATESUMMARY;
+
 WORKSPACE *AllocateWorkspace(void) {
   WORKSPACE *ws = calloc(1, sizeof(WORKSPACE));
 
@@ -128,30 +239,18 @@ WORKSPACE *AllocateWorkspace(void) {
     return NULL;
   }
 
-  // Allocate DynamicStringArray to hold filenames of zipped files.
-  ws->iElements = ARRAY_ELEMENTS;
-  ws->FileNameArray = DynamicStringArrayCreate(ws->iElements);
-
-  if (!ws->FileNameArray) {
+  if (TzDeflateInit(&ws->zsDeflate) != Z_OK) {
     free(ws->pszDataBuf);
     free(ws);
     return NULL;
   }
 
-  // Set up the dates just like MAMEZip
-  // 1996 12 24 23:32 GMT+1 (MAME's first release date)
-  ws->zi.tmz_date.tm_sec = 0;
-  ws->zi.tmz_date.tm_min = 32;
-  ws->zi.tmz_date.tm_hour = 23;
-  ws->zi.tmz_date.tm_mday = 24;
-  ws->zi.tmz_date.tm_mon = 11;
-  ws->zi.tmz_date.tm_year = 1996;
-
-  // Do not set file type (ASCII, BINARY)
-  ws->zi.internal_fa = 0;
-  // Do not use any RASH (Read only, Archive, System, Hidden) values
-  ws->zi.external_fa = 0;
-  ws->zi.dosDate = 0;
+  if ((ws->pDecoder = DecoderCreate()) == NULL) {
+    deflateEnd(&ws->zsDeflate);
+    free(ws->pszDataBuf);
+    free(ws);
+    return NULL;
+  }
 
   return ws;
 }
@@ -160,69 +259,96 @@ void FreeWorkspace(WORKSPACE *ws) {
   if (ws->fErrorLog)
     fclose(ws->fErrorLog);
 
-  if (ws->FileNameArray)
-    DynamicStringArrayDestroy(ws->FileNameArray, ws->iElements);
+  StringTableFree(&ws->Names);
+  free(ws->Entries);
   free(ws->pszDataBuf);
+  deflateEnd(&ws->zsDeflate);
+  DecoderFree(ws->pDecoder);
   free(ws->pszLogDir);
   free(ws->pszErrorLogFile);
   free(ws);
 }
 
-// Stores file list from the zip file in original order in
-// ws->FileNameArray (the old contents will be overwritten).
-static int GetFileList(unzFile UnZipHandle, WORKSPACE *ws) {
-  int rc = UNZ_END_OF_LIST_OF_FILE;
+// Stores file list from the zip file in original order in ws->Entries,
+// with the names in ws->Names (the old contents will be overwritten).
+static int GetFileList(const CENTRALDIR *cd, WORKSPACE *ws) {
   size_t iCount;
-  unz_global_info64 GlobalInfo;
+  size_t off = 0;
+  CENTRALDIRENTRY e;
+  ZIPENTRY *pEntry;
 
-  if (unzGetGlobalInfo64(UnZipHandle, &GlobalInfo) != UNZ_OK)
+  // Far more entries than any real archive has. This keeps the sizes
+  // below in range.
+  if (cd->cEntries >= INT_MAX / sizeof(ZIPENTRY))
     return TZ_ERR;
 
-  if (!(ws->FileNameArray = DynamicStringArrayGrow(
-            ws->FileNameArray, &ws->iElements, GlobalInfo.number_entry + 1)))
-    return TZ_CRITICAL;
+  if ((ZPOS64_T)ws->iEntryElements <= cd->cEntries) {
+    int iElements = ws->iEntryElements ? ws->iEntryElements : ARRAY_ELEMENTS;
+    ZIPENTRY *Entries;
+    while ((ZPOS64_T)iElements <= cd->cEntries)
+      iElements *= 2;
+    if (!(Entries = realloc(ws->Entries, iElements * sizeof(ZIPENTRY))))
+      return TZ_CRITICAL;
+    ws->Entries = Entries;
+    ws->iEntryElements = iElements;
+  }
 
-  if (GlobalInfo.number_entry != 0)
-    rc = unzGoToFirstFile(UnZipHandle);
+  StringTableReset(&ws->Names);
+  ws->iEntries = 0;
 
-  for (iCount = 0; rc == UNZ_OK && iCount < GlobalInfo.number_entry;
-       iCount++, rc = unzGoToNextFile(UnZipHandle)) {
-    unz_file_info64 ZipInfo;
+  for (iCount = 0; iCount < cd->cEntries; iCount++) {
+    if (CentralDirEntry(cd, &off, &e) != TZ_OK || e.cchName >= MAX_PATH ||
+        e.cchName == 0 || memchr(e.pName, 0, e.cchName))
+      return TZ_ERR;
 
-    rc = unzGetCurrentFileInfo64(UnZipHandle, &ZipInfo,
-                                 ws->FileNameArray[iCount], MAX_PATH, NULL, 0,
-                                 NULL, 0);
-    if (rc != UNZ_OK || ZipInfo.size_filename >= MAX_PATH ||
-        ZipInfo.size_filename == 0)
-      break;
+    pEntry = &ws->Entries[iCount];
+    if (StringTableAddName(&ws->Names, e.pName, e.cchName, &pEntry->iName) !=
+        TZ_OK)
+      return TZ_CRITICAL;
+    pEntry->cchName = e.cchName;
+    pEntry->pos.pos_in_zip_directory = cd->offCentralDir + e.offEntry;
+    pEntry->pos.num_of_file = iCount;
+    pEntry->posLocalHeader =
+        cd->posCentralDir - cd->offCentralDir + e.offLocalHeader;
+    pEntry->iMethod = e.iMethod;
+    pEntry->crc = e.crc;
+    pEntry->cCompressed = e.cCompressed;
+    pEntry->cUncompressed = e.cUncompressed;
   }
-  ws->FileNameArray[iCount][0] = 0;
 
-  return rc == UNZ_END_OF_LIST_OF_FILE && iCount == GlobalInfo.number_entry
-             ? TZ_OK
-             : TZ_ERR;
+  // The list ends with an empty name
+  if (StringTableAddName(&ws->Names, "", 0, &ws->Entries[iCount].iName) !=
+      TZ_OK)
+    return TZ_CRITICAL;
+  ws->Entries[iCount].cchName = 0;
+
+  // The names don't move anymore
+  for (ws->iEntries = 0; ws->iEntries <= (int)iCount; ws->iEntries++)
+    SortNameInit(
+        (SORTNAME *)&ws->Entries[ws->iEntries],
+        StringTableString(&ws->Names, ws->Entries[ws->iEntries].iName),
+        qStripSubdirs);
+  ws->iEntries = iCount;
+
+  return TZ_OK;
 }
 
-int CheckZipStatus(unz64_s *UnzipStream, WORKSPACE *ws) {
-  unsigned long checksum, target_checksum = 0;
-  off_t ch_length = UnzipStream->size_central_dir;
-  off_t ch_offset = UnzipStream->central_pos - UnzipStream->size_central_dir;
+int CheckZipStatus(MAPFILE *mf, const CENTRALDIR *cd, WORKSPACE *ws) {
+  unsigned long target_checksum = 0;
   char comment_buffer[COMMENT_LENGTH + 1];
   char *ep = NULL;
-  FILE *f = (FILE *)UnzipStream->filestream;
 
   // Quick check that the file at least appears to be a zip file.
-  rewind(f);
-  if (fgetc(f) != 'P' || fgetc(f) != 'K')
+  if (MapFileRead(mf, 0, comment_buffer, 2) || comment_buffer[0] != 'P' ||
+      comment_buffer[1] != 'K')
     return STATUS_ERROR;
 
   // Assume a TZ style archive comment and read it in. This is located at the
   // very end of the file.
   comment_buffer[COMMENT_LENGTH] = 0;
-  if (fseeko64(f, -COMMENT_LENGTH, SEEK_END))
-    return STATUS_ERROR;
-
-  if (fread(comment_buffer, 1, COMMENT_LENGTH, f) != COMMENT_LENGTH)
+  if (MapFileSize(mf) < COMMENT_LENGTH ||
+      MapFileRead(mf, MapFileSize(mf) - COMMENT_LENGTH, comment_buffer,
+                  COMMENT_LENGTH))
     return STATUS_ERROR;
 
   // Check static portion of comment.
@@ -236,42 +362,31 @@ int CheckZipStatus(unz64_s *UnzipStream, WORKSPACE *ws) {
   if (errno || ep != comment_buffer + COMMENT_LENGTH)
     return STATUS_BAD_COMMENT;
 
-  // Comment checks out so skip to start of the central header.
-  if (fseeko64(f, ch_offset, SEEK_SET))
-    return STATUS_ERROR;
-
-  // Read it in and calculate the crc32.
-  checksum = crc32(0L, NULL, 0);
-  while (ch_length > 0) {
-    size_t read_length = ws->iBufSize < ch_length ? ws->iBufSize : ch_length;
-    if (fread(ws->pszDataBuf, 1, read_length, f) != read_length)
-      return STATUS_ERROR;
-
-    checksum = crc32(checksum, ws->pszDataBuf, read_length);
-    ch_length -= read_length;
-  }
+  // The CRC32 of the central directory was taken when it was read
+  ws->crcCentralDir = cd->crc;
 
-  return checksum == target_checksum ? STATUS_OK : STATUS_OUT_OF_DATE;
+  return cd->crc == target_checksum ? STATUS_OK : STATUS_OUT_OF_DATE;
 }
 
 // check if the zip file entry is a directory that should be removed
 // directory should not be removed if it is an empty directory
 int ShouldFileBeRemoved(int iArray, WORKSPACE *ws) {
-  int len;
-  const char *entry = ws->FileNameArray[iArray];
-  const char *slash = strrchr(entry, '/');
+  const ZIPENTRY *e = &ws->Entries[iArray];
+  const char *entry = e->pszName;
+  const char *key = e->pszKey;
+  size_t len = e->cchName;
 
-  if (!slash || slash[1]) // not a directory
+  if (len == 0 || entry[len - 1] != '/') // not a directory
     return 0;
 
-  len = slash - entry + 1;
   // Although the list is sorted, checking the next entry isn't sufficient.
   // Entries with different case can appear between the directory and the
-  // files inside (e.g. A/, a/, A/x, a/y).
+  // files inside (e.g. A/, a/, A/x, a/y). The empty name at the end
+  // stops the search.
   do {
-    if (!strncmp(entry, ws->FileNameArray[++iArray], len))
+    if ((++e)->cchName >= len && !memcmp(entry, e->pszName, len))
       return 1; // can be removed
-  } while (!strncasecmp(entry, ws->FileNameArray[iArray], len));
+  } while (e->cchName >= len && !memcmp(key, e->pszKey, len));
 
   return 0;
 }
@@ -279,7 +394,7 @@ int ShouldFileBeRemoved(int iArray, WORKSPACE *ws) {
 // find if the zipfiles contains any dir entries that should be removed
 int ZipHasDirEntry(WORKSPACE *ws) {
   int iArray = 0;
-  for (iArray = 0; strlen(ws->FileNameArray[iArray]); iArray++) {
+  for (iArray = 0; iArray < ws->iEntries; iArray++) {
     if (ShouldFileBeRemoved(iArray, ws))
       return 1;
   }
@@ -288,8 +403,8 @@ int ZipHasDirEntry(WORKSPACE *ws) {
 
 static int ZipHasSubdirs(WORKSPACE *ws) {
   int iArray;
-  for (iArray = 0; *ws->FileNameArray[iArray]; iArray++)
-    if (strchr(ws->FileNameArray[iArray], '/'))
+  for (iArray = 0; iArray < ws->iEntries; iArray++)
+    if (memchr(ws->Entries[iArray].pszName, '/', ws->Entries[iArray].cchName))
       return 1;
   return 0;
 }
@@ -298,29 +413,39 @@ static int ZipHasSubdirs(WORKSPACE *ws) {
 // older trrntzip didn't always sort properly
 static int ZipHasWrongOrder(WORKSPACE *ws) {
   int iArray;
-  if (*ws->FileNameArray[0])
-    for (iArray = 1; *ws->FileNameArray[iArray]; iArray++)
-      if (CanonicalCmp(ws->FileNameArray[iArray - 1],
-                       ws->FileNameArray[iArray]) >= 0)
-        return 1;
+  for (iArray = 1; iArray < ws->iEntries; iArray++)
+    if (SortNameCmp((const SORTNAME *)&ws->Entries[iArray - 1],
+                    (const SORTNAME *)&ws->Entries[iArray]) >= 0)
+      return 1;
   return 0;
 }
 
-int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
-               MIGRATE *mig) {
-  unz_file_info64 ZipInfo;
+// Rezip pDir/zip_path to pszOutPath, or in place if that is NULL
+int MigrateZip(const char *zip_path, const char *pDir, const char *pszOutPath,
+               WORKSPACE *ws, MIGRATE *mig) {
+  MAPFILE *mf = NULL;
+  CENTRALDIR cd;
   unzFile UnZipHandle = NULL;
-  unz64_s *UnzipStream = NULL;
-  zipFile ZipHandle = NULL;
+  TZWRITER *tw = NULL;
+  MEMBERS *members = NULL;
+  const MEMBER *member = NULL;
+  MEMBER Compressed = {NULL, 0, 0, 0};
+  READAHEAD *readahead = NULL;
+  ARCHIVESTATS *as = ws->pStats;
+  PROGRESSJOB *pj = ws->pProgress;
+  ZPOS64_T cbIn = 0; // of the source, accounted to pj
+  int bReadAhead = 0;
+  int bRawCopy = 0;
+  int bInOrder = 0;
+  int bRaw = 0;
+  const void *pData = NULL;
   int zip64 = 0;
   int tmpfd;
-
-  // Used for CRC32 calc of central directory during rezipping
-  zip64_internal *zintinfo;
-  linkedlist_datablock_internal *ldi;
+  struct stat st;
 
   // Used for our dynamic filename array
   int iArray = 0;
+  int iEntries = 0;
 
   int rc = 0;
   int error = 0;
@@ -332,6 +457,7 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
   char *pszZipName = NULL;
 
   int iBytesRead = 0;
+  ZPOS64_T cBytesRead = 0;
 
   off_t cTotalBytesInZip = 0;
   unsigned int cTotalFilesInZip = 0;
@@ -349,37 +475,62 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
              zip_path);
   }
 
-  if (access(szZipFileName, R_OK | W_OK)) {
+  // Renaming is cheapest when the temporary file is next to its
+  // destination, anything else means copying
+  if (pszTmpDir) {
+    snprintf(szTmpZipFileName, sizeof(szTmpZipFileName), "%s%c%s", pszTmpDir,
+             DIRSEP, TMP_FILENAME);
+  } else if (pszOutPath) {
+    const char *pszSep = strrchr(pszOutPath, DIRSEP);
+    snprintf(szTmpZipFileName, sizeof(szTmpZipFileName), "%.*s%s",
+             (int)(pszSep - pszOutPath + 1), pszOutPath, TMP_FILENAME);
+  }
+
+  ws->iZipStatus = STATUS_ERROR;
+
+  if (access(szZipFileName, qCheckOnly || pszOutPath ? R_OK : R_OK | W_OK)) {
     logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
               "Error opening \"%s\". %s.\n", szZipFileName, strerror(errno));
     return TZ_ERR;
   }
 
-  if ((UnZipHandle = unzOpen64(szZipFileName)) == NULL) {
+  if ((mf = MapFileOpen(szZipFileName)) == NULL ||
+      (rc = CentralDirRead(mf, &cd)) == TZ_ERR) {
     logprint3(
         stderr, mig->fProcessLog, ErrorLog(ws),
         "Error opening \"%s\", zip format problem. Unable to process zip.\n",
         szZipFileName);
+    if (mf)
+      MapFileClose(mf);
     return TZ_ERR;
   }
-
-  UnzipStream = (unz64_s *)UnZipHandle;
+  StatsLap(as, PHASE_OPEN);
+  if (as)
+    as->cbRead = cd.cbCentralDir;
+  cbIn = cd.cbCentralDir;
+  ProgressJobUpdate(pj, szZipFileName, NULL, cbIn, 0);
 
   // Check if zip is non-TZ or altered-TZ
-  rc = CheckZipStatus(UnzipStream, ws);
+  if (rc == TZ_OK)
+    rc = CheckZipStatus(mf, &cd, ws);
+  else
+    rc = STATUS_ALLOC_ERROR;
+  StatsLap(as, PHASE_CHECK);
 
   switch (rc) {
   case STATUS_ERROR:
     logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
               "Unable to process \"%s\". It seems to be corrupt.\n",
               szZipFileName);
-    unzClose(UnZipHandle);
+    CentralDirFree(&cd);
+    MapFileClose(mf);
     return TZ_ERR;
 
   case STATUS_ALLOC_ERROR:
     logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
               "Error allocating memory!\n");
-    unzClose(UnZipHandle);
+    CentralDirFree(&cd);
+    MapFileClose(mf);
     return TZ_CRITICAL;
 
   case STATUS_OK:
@@ -391,53 +542,70 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
   default:
     logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
               "Bad return on CheckZipStatus!\n");
-    unzClose(UnZipHandle);
+    CentralDirFree(&cd);
+    MapFileClose(mf);
     return TZ_CRITICAL;
   }
 
-  CHECK_DYNAMIC_STRING_ARRAY(ws->FileNameArray, ws->iElements);
-  // Get the filelist from the zip file in original order in ws->FileNameArray
-  switch (GetFileList(UnZipHandle, ws)) {
+  // Get the filelist from the zip file in original order in ws->Entries
+  switch (GetFileList(&cd, ws)) {
   case TZ_OK:
     break;
   case TZ_CRITICAL:
     logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
               "Error allocating memory!\n");
-    unzClose(UnZipHandle);
+    CentralDirFree(&cd);
+    MapFileClose(mf);
     return TZ_CRITICAL;
   default:
     logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
               "Could not list contents of \"%s\". File is corrupted or "
               "contains entries with bad names.\n", szZipFileName);
-    unzClose(UnZipHandle);
+    CentralDirFree(&cd);
+    MapFileClose(mf);
     return TZ_ERR;
   }
-  CHECK_DYNAMIC_STRING_ARRAY(ws->FileNameArray, ws->iElements);
 
-  // GetFileList couldn't allocate enough memory to store the filelist
-  if (!ws->FileNameArray) {
-    logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
-              "Error allocating memory!\n");
-    unzClose(UnZipHandle);
-    return TZ_CRITICAL;
+  // Everything needed from the central directory is in ws->Entries now
+  CentralDirFree(&cd);
+  StatsLap(as, PHASE_LIST);
+
+  if (as) {
+    as->cMembers = ws->iEntries;
+    for (iArray = 0; iArray < ws->iEntries; iArray++) {
+      as->cCompressed += ws->Entries[iArray].cCompressed;
+      as->cUncompressed += ws->Entries[iArray].cUncompressed;
+    }
   }
 
-  if (rc == STATUS_OK && qForceReZip)
+  if (rc == STATUS_OK && qForceReZip && !qCheckOnly)
     rc = STATUS_FORCE_REZIP;
 
-  if (rc == STATUS_OK && ZipHasWrongOrder(ws))
+  bInOrder = !ZipHasWrongOrder(ws);
+  if (rc == STATUS_OK && !bInOrder)
     rc = STATUS_WRONG_ORDER;
 
-  // Sort filelist into canonical order
-  for (iArray = 0; iArray < ws->iElements && ws->FileNameArray[iArray][0];
-       iArray++)
-    ;
-  qsort(ws->FileNameArray, iArray, sizeof(char *),
-        qStripSubdirs ? BasenameCompare : StringCompare);
+  // Sort filelist into canonical order, keeping each name's position.
+  // Archives written by TorrentZip are in that order already.
+  iEntries = ws->iEntries;
+  if (!bInOrder || qStripSubdirs)
+    qsort(ws->Entries, iEntries, sizeof(ZIPENTRY),
+          qStripSubdirs ? BasenameCompare : SortNameCompare);
+  StatsLap(as, PHASE_SORT);
 
   // Check if the zip has redundant directories
-  if (rc == STATUS_OK && qStripSubdirs ? ZipHasSubdirs(ws) : ZipHasDirEntry(ws))
+  if (rc == STATUS_OK &&
+      (qStripSubdirs ? ZipHasSubdirs(ws) : ZipHasDirEntry(ws)))
     rc = STATUS_CONTAINS_DIRS;
+  StatsLap(as, PHASE_CHECK);
+
+  ws->iZipStatus = rc;
+
+  // Only report, RetireMigrateJob does that
+  if (qCheckOnly) {
+    MapFileClose(mf);
+    return rc == STATUS_OK ? TZ_SKIPPED : TZ_OK;
+  }
 
   // All checks passed, zip is up to date - skip it!
   if (rc == STATUS_OK) {
@@ -445,14 +613,52 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
       logprint(stdout, mig->fProcessLog,
                "Skipping, already TorrentZipped - %s\n", szZipFileName);
     }
-    unzClose(UnZipHandle);
+    MapFileClose(mf);
+
+    // The output tree gets a copy, unless it's already there
+    if (pszOutPath && stat(pszOutPath, &st)) {
+      const char *pErr = NULL;
+      if (MakeParentDirs(pszOutPath))
+        pErr = strerror(errno);
+      else
+        pErr = ReplaceWithCopy(pszOutPath, szZipFileName);
+      StatsLap(as, PHASE_WRITE);
+      if (pErr) {
+        logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
+                  "Could not copy \"%s\" to \"%s\". %s\n", szZipFileName,
+                  pszOutPath, pErr);
+        return TZ_ERR;
+      }
+    }
+
     return TZ_SKIPPED;
   }
 
+  if (pszOutPath && MakeParentDirs(pszOutPath)) {
+    logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
+              "Could not create directories for \"%s\". %s\n", pszOutPath,
+              strerror(errno));
+    MapFileClose(mf);
+    return TZ_ERR;
+  }
+
+  // minizip reads the members, from the file opened already
+  StatsLap(as, PHASE_OTHER);
+  UnZipHandle = MapFileUnzip(mf);
+  StatsLap(as, PHASE_OPEN);
+  if (UnZipHandle == NULL) {
+    logprint3(
+        stderr, mig->fProcessLog, ErrorLog(ws),
+        "Error opening \"%s\", zip format problem. Unable to process zip.\n",
+        szZipFileName);
+    return TZ_ERR;
+  }
+
   // ReZip it!
   logprint(stdout, mig->fProcessLog, "Rezipping - %s\n", szZipFileName);
   logprint(stdout, mig->fProcessLog, "%s\n", DIVIDER);
 
+  StatsLap(as, PHASE_OTHER);
   tmpfd = mkstemp(szTmpZipFileName);
   if (tmpfd < 0) {
     logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
@@ -461,31 +667,82 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
     unzClose(UnZipHandle);
     return TZ_CRITICAL;
   }
-  // Close the file and let zipOpen64() reopen it. It can't be accidentally
-  // claimed by a different process since it already exists on disk. If an
-  // attacker is able to replace it, we've lost anyway.
-  close(tmpfd);
 
-  if ((ZipHandle = zipOpen64(szTmpZipFileName, 0)) == NULL) {
+  // Small zips are built in memory and written in one go. The new zip
+  // will be about as big as the old one.
+  if (cd.posCentralDir + cd.cbCentralDir < cbMemZip)
+    tw = TzWriterCreate(tmpfd, cd.posCentralDir + 2 * cd.cbCentralDir +
+                                   64 * 1024,
+                        cd.cbCentralDir, &ws->zsDeflate);
+  else
+    tw = TzWriterCreate(tmpfd, TZWRITER_BUFFER_SIZE, cd.cbCentralDir,
+                        &ws->zsDeflate);
+
+  if (tw == NULL) {
     logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
               "Error opening temporary zip file %s. Unable to process \"%s\"\n",
               szTmpZipFileName, szZipFileName);
     unzClose(UnZipHandle);
+    close(tmpfd);
     remove(szTmpZipFileName);
     return TZ_ERR;
   }
+  if (as)
+    TzWriterCount(tw, &as->nsWriter, &as->cbWritten);
+  StatsLap(as, PHASE_WRITE);
+
+  // The central directory checksum matched, so all members were written by
+  // TorrentZip and their compressed data can be copied as is.
+  bRawCopy = rc == STATUS_WRONG_ORDER || rc == STATUS_CONTAINS_DIRS;
+
+  // Let other threads compress members ahead of us, if requested. Members
+  // too big for that are inflated ahead by another thread, so we only
+  // deflate here. Without member threads, large members are still
+  // inflated ahead, except those compressed up front for the stream cache.
+  if (iMemberThreads > 1 && !bRawCopy) {
+    members = MembersStart(szZipFileName, ws->Entries, iEntries,
+                           iMemberThreads, StreamCache);
+    readahead = ReadAheadStart(szZipFileName, ws->Entries, iEntries,
+                               members ? MEMBER_MAX_BUFFERED + 1 : 0);
+  } else if (!bRawCopy) {
+    readahead = ReadAheadStart(szZipFileName, ws->Entries, iEntries,
+                               StreamCache ? MEMBER_MAX_BUFFERED + 1
+                                           : READAHEAD_MIN_SIZE);
+  }
 
-  for (iArray = 0; iArray < ws->iElements && ws->FileNameArray[iArray][0];
-       iArray++) {
-    strcpy(szFileName, ws->FileNameArray[iArray]);
-    rc = unzLocateFile(UnZipHandle, szFileName, 1);
+  for (iArray = 0; iArray < iEntries; iArray++) {
+    StatsLap(as, PHASE_OTHER);
+    strcpy(szFileName, ws->Entries[iArray].pszName);
+    rc = unzGoToFilePos64(UnZipHandle, &ws->Entries[iArray].pos);
     zip64 = 0;
+    bRaw = 0;
+    member = NULL;
+    bReadAhead = 0;
+    free(Compressed.pData);
+    Compressed.pData = NULL;
 
     if (rc == UNZ_OK) {
-      rc = unzGetCurrentFileInfo64(UnZipHandle, &ZipInfo, szFileName, MAX_PATH,
-                                   NULL, 0, NULL, 0);
-      if (rc == UNZ_OK)
-        rc = unzOpenCurrentFile(UnZipHandle);
+      bRaw = bRawCopy && ws->Entries[iArray].iMethod == Z_DEFLATED;
+      StatsLap(as, PHASE_INFLATE);
+      // A member compressed ahead is stored as is. Without member
+      // threads, members the stream cache could have are compressed up
+      // front here. This stays on the current member.
+      if (members)
+        member = MembersGet(members, iArray);
+      else if (StreamCache && !bRaw &&
+               ws->Entries[iArray].cUncompressed >= STREAMCACHE_MIN_SIZE &&
+               MemberCompress(UnZipHandle, &ws->Entries[iArray].pos,
+                              ws->pszDataBuf, ws->iBufSize, &ws->zsDeflate,
+                              &Compressed, StreamCache))
+        member = &Compressed;
+      StatsLap(as, PHASE_DEFLATE);
+      // Only members not compressed already are read, and those inflated
+      // ahead by the other thread are not read here
+      bReadAhead = !member && readahead && ReadAheadOpen(readahead, iArray);
+      if (!member && !bReadAhead)
+        rc = DecoderOpen(ws->pDecoder, UnZipHandle, mf, &ws->Entries[iArray],
+                         bRaw);
+      StatsLap(as, PHASE_INFLATE);
     }
 
     if (rc != UNZ_OK) {
@@ -497,7 +754,7 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
     }
 
     // files >= 4G need to be zip64
-    if (ZipInfo.uncompressed_size >= 0xFFFFFFFF)
+    if (ws->Entries[iArray].cUncompressed >= 0xFFFFFFFF)
       zip64 = 1;
 
     if (qStripSubdirs) {
@@ -512,7 +769,8 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
           continue;
         }
 
-        strcpy(ws->FileNameArray[iArray], pszZipName);
+        strcpy(ws->Entries[iArray].pszName, pszZipName);
+        ws->Entries[iArray].cchName = strlen(pszZipName);
       } else
         pszZipName = szFileName;
     } else {
@@ -528,7 +786,7 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
     }
 
     // Check for duplicate files (but allow files differing only in case)
-    if (iArray > 0 && !strcmp(pszZipName, ws->FileNameArray[iArray - 1])) {
+    if (iArray > 0 && !strcmp(pszZipName, ws->Entries[iArray - 1].pszName)) {
       logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
                 "Zip file \"%s\" contains more than one file named \"%s\"\n",
                 szZipFileName, pszZipName);
@@ -538,12 +796,25 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
 
     logprint(stdout, mig->fProcessLog,
              "Adding - %s (%" PRIu64 " bytes%s%s%s)...", pszZipName,
-             ZipInfo.uncompressed_size, (zip64 ? ", Zip64" : ""),
+             ws->Entries[iArray].cUncompressed, (zip64 ? ", Zip64" : ""),
              (pszZipName == szFileName ? "" : ", was: "),
              (pszZipName == szFileName ? "" : szFileName));
 
-    rc = zipOpenNewFileInZip64(ZipHandle, pszZipName, &ws->zi, NULL, 0, NULL, 0,
-                               NULL, Z_DEFLATED, Z_BEST_COMPRESSION, zip64);
+    StatsLap(as, PHASE_OTHER);
+
+    // Data deflated already is known well enough to write the whole local
+    // header up front
+    if (member)
+      rc = TzWriterOpenRawMember(tw, pszZipName, zip64, member->cbData,
+                                 member->cUncompressed, member->crc);
+    else if (bRaw)
+      rc = TzWriterOpenRawMember(tw, pszZipName, zip64,
+                                 ws->Entries[iArray].cCompressed,
+                                 ws->Entries[iArray].cUncompressed,
+                                 ws->Entries[iArray].crc);
+    else
+      rc = TzWriterOpenMember(tw, pszZipName, zip64);
+    StatsLap(as, PHASE_DEFLATE);
 
     if (rc != ZIP_OK) {
       logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
@@ -553,9 +824,28 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
       break;
     }
 
-    for (;;) {
-      iBytesRead =
-          unzReadCurrentFile(UnZipHandle, ws->pszDataBuf, ws->iBufSize);
+    if (member) {
+      rc = TzWriterWrite(tw, member->pData, member->cbData);
+      StatsLap(as, PHASE_DEFLATE);
+      if (rc != ZIP_OK) {
+        logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
+                  "Error while adding \"%s\" to replacement zip \"%s\"\n",
+                  pszZipName, szTmpZipFileName);
+        error = 1;
+        break;
+      }
+      cTotalBytesInZip += member->cUncompressed;
+    }
+
+    cBytesRead = 0;
+
+    while (!member) {
+      if (bReadAhead) {
+        iBytesRead = ReadAheadRead(readahead, &pData);
+      } else {
+        iBytesRead = DecoderRead(ws->pDecoder, &pData);
+      }
+      StatsLap(as, PHASE_INFLATE);
 
       if (!iBytesRead) { // All bytes have been read.
         break;
@@ -570,7 +860,8 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
         break;
       }
 
-      rc = zipWriteInFileInZip(ZipHandle, ws->pszDataBuf, iBytesRead);
+      rc = TzWriterWrite(tw, pData, iBytesRead);
+      StatsLap(as, PHASE_DEFLATE);
 
       if (rc != ZIP_OK) {
         logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
@@ -580,13 +871,40 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
         break;
       }
 
-      cTotalBytesInZip += iBytesRead;
+      cBytesRead += iBytesRead;
+
+      // Source read so far, estimated from how much of it was inflated
+      if (pj && (bRaw || ws->Entries[iArray].cUncompressed))
+        ProgressJobUpdate(
+            pj, szZipFileName, pszZipName,
+            cbIn + (bRaw ? cBytesRead
+                         : (ZPOS64_T)((double)cBytesRead *
+                                      ws->Entries[iArray].cCompressed /
+                                      ws->Entries[iArray].cUncompressed)),
+            TzWriterOffset(tw));
     }
 
     if (error)
       break;
 
-    rc = unzCloseCurrentFile(UnZipHandle);
+    if (bRaw)
+      cTotalBytesInZip += ws->Entries[iArray].cUncompressed;
+    else if (!member)
+      cTotalBytesInZip += cBytesRead;
+
+    if (member)
+      rc = UNZ_OK;
+    else if (bReadAhead)
+      rc = ReadAheadClose(readahead);
+    else
+      rc = DecoderClose(ws->pDecoder);
+    StatsLap(as, PHASE_INFLATE);
+
+    // The CRC from the central directory goes into the new zip as is. It
+    // was checked while reading, unless the data ended early.
+    if (rc == UNZ_OK && !member && !bRaw &&
+        cBytesRead != ws->Entries[iArray].cUncompressed)
+      rc = UNZ_CRCERROR;
 
     if (rc != UNZ_OK) {
       if (rc == UNZ_CRCERROR)
@@ -602,7 +920,12 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
       break;
     }
 
-    rc = zipCloseFileInZip(ZipHandle);
+    if (member)
+      rc = TzWriterCloseMember(tw, member->cUncompressed, member->crc);
+    else
+      rc = TzWriterCloseMember(tw, ws->Entries[iArray].cUncompressed,
+                               ws->Entries[iArray].crc);
+    StatsLap(as, PHASE_DEFLATE);
 
     if (rc != ZIP_OK) {
       logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
@@ -615,13 +938,23 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
     logprint(stdout, mig->fProcessLog, "Done\n");
 
     cTotalFilesInZip++;
+    if (as)
+      as->cbRead += ws->Entries[iArray].cCompressed;
+    cbIn += ws->Entries[iArray].cCompressed;
+    ProgressJobUpdate(pj, szZipFileName, pszZipName, cbIn, TzWriterOffset(tw));
   }
 
+  if (members)
+    MembersStop(members);
+  if (readahead)
+    ReadAheadStop(readahead);
+  free(Compressed.pData);
+
   // If there was an error above then clean up and return.
   if (error) {
     logprint(stdout, mig->fProcessLog, "Not done\n");
     unzClose(UnZipHandle);
-    zipClose(ZipHandle, NULL);
+    TzWriterFree(tw);
     remove(szTmpZipFileName);
     return TZ_ERR;
   }
@@ -630,34 +963,40 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
 
   unzClose(UnZipHandle);
 
-  // Before we close the file, we need to calc the CRC32 of
-  // the central directory (for detecting a changed TZ file later)
-  zintinfo = (zip64_internal *)ZipHandle;
-  crc = crc32(0L, Z_NULL, 0);
-  ldi = zintinfo->central_dir.first_block;
-  while (ldi != NULL) {
-    crc = crc32(crc, ldi->data, ldi->filled_in_this_block);
-    ldi = ldi->next_datablock;
-  }
-
-  // Set the global file comment, so that we know to skip this file in future
+  // The CRC32 of the central directory (for detecting a changed TZ file
+  // later) goes into the global file comment, so that we know to skip
+  // this file in future
+  crc = TzWriterCentralDirCrc(tw);
   snprintf(szTmpBuf, sizeof(szTmpBuf), "%s%08lX", gszApp, crc);
+  ws->crcCentralDir = crc;
+
+  StatsLap(as, PHASE_OTHER);
+  rc = TzWriterClose(tw, szTmpBuf);
+  StatsLap(as, PHASE_DEFLATE);
 
-  rc = zipClose(ZipHandle, szTmpBuf);
+  if (rc == ZIP_OK) {
+    const char *pszDest = pszOutPath ? pszOutPath : szZipFileName;
+    const char *pErr;
 
-  if (rc == UNZ_OK) {
-    const char *pErr = UpdateFile(szZipFileName, szTmpZipFileName);
+#ifndef WIN32
+    // A new file in the output tree gets the source's permissions
+    if (pszOutPath && !stat(szZipFileName, &st))
+      chmod(szTmpZipFileName, st.st_mode & ~S_IFMT);
+#endif
+
+    StatsLap(as, PHASE_OTHER);
+    pErr = UpdateFile(pszDest, szTmpZipFileName);
+    StatsLap(as, PHASE_RENAME);
     if (pErr) {
       logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
                 "!!!! Could not rename temporary file \"%s\" to \"%s\". %s\n",
-                szTmpZipFileName, szZipFileName, pErr);
+                szTmpZipFileName, pszDest, pErr);
       return TZ_CRITICAL;
     }
   } else {
-    logprint3(
-        stderr, mig->fProcessLog, ErrorLog(ws),
-        "Unable to close temporary zip file \"%s\" - cannot process \"%s\"!\n",
-        szTmpZipFileName, szZipFileName);
+    logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
+              "Error writing temporary zip file \"%s\". %s\n",
+              szTmpZipFileName, strerror(errno));
     remove(szTmpZipFileName);
     return TZ_ERR;
   }
@@ -670,197 +1009,580 @@ int MigrateZip(const char *zip_path, const char *pDir, WORKSPACE *ws,
   return TZ_OK;
 }
 
-// Get the filelist from the open dirp directory in canonical order
-// Returns a sorted array
-static char **GetDirFileList(DIR *dirp, int *piElements) {
-  int iCount = 0;
-  struct dirent *direntp = NULL;
-  char **FileNameArray = 0;
+// Process a single archive on a worker
+static int MigrateJob(void *arg, WORKSPACE *ws) {
+  MIGRATEJOB *job = arg;
+  MIGRATE *mig = job->mig;
+  char szRelPathBuf[MAX_PATH + 1];
+  const char *pszFileName = NULL;
+  int rc = TZ_ERR;
 
-  *piElements = ARRAY_ELEMENTS;
-  FileNameArray = DynamicStringArrayCreate(*piElements);
-  if (!FileNameArray)
-    return NULL;
+  ws->pStats = Stats ? &job->Stats : NULL;
+  StatsBegin(ws->pStats);
+  ws->pProgress = qProgress ? &job->Progress : NULL;
+  ProgressJobStart(ws->pProgress, job->st.st_size);
 
-  while ((direntp = readdir(dirp))) {
-    if (!(FileNameArray =
-              DynamicStringArrayGrow(FileNameArray, piElements, iCount + 1)))
-      return NULL;
+  pszFileName = strrchr(job->szRelPath, DIRSEP);
+  if (pszFileName) {
+    memcpy(szRelPathBuf, job->szRelPath, pszFileName - job->szRelPath);
+    szRelPathBuf[pszFileName - job->szRelPath] = 0;
+    pszFileName++;
+  } else {
+    snprintf(szRelPathBuf, sizeof(szRelPathBuf), ".");
+    pszFileName = job->szRelPath;
+  }
+
+  // minimum size of an empty zip file is 22 bytes, non-empty 98 bytes
+  if (job->st.st_size >= 22) {
+    char szOutPath[MAX_PATH + 1];
+
+    if (pszOutDir && !qCheckOnly)
+      snprintf(szOutPath, sizeof(szOutPath), "%s%c%s", pszOutDir, DIRSEP,
+               job->szRelPath + job->iOutPos);
+    rc = MigrateZip(pszFileName, szRelPathBuf,
+                    pszOutDir && !qCheckOnly ? szOutPath : NULL, ws, mig);
+
+    job->iStatus = ws->iZipStatus;
+    job->crc = ws->crcCentralDir;
+    // The status cache has to know the rezipped file. One written
+    // elsewhere doesn't make the source TorrentZipped.
+    if (rc == TZ_OK && !qCheckOnly && StatusCache &&
+        (pszOutDir || stat(job->szRelPath, &job->st)))
+      job->st.st_ino = 0;
+  } else if (job->st.st_size) {
+    // Too small to be a valid zip file.
+    logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
+              "\"%s\" is too small (%d byte%s). File may be corrupt.\n",
+              job->szRelPath, (int)job->st.st_size,
+              job->st.st_size == 1 ? "" : "s");
+  } else {
+    logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
+              "\"%s\" is empty. Skipping.\n", job->szRelPath);
+  }
+
+  StatsEnd(ws->pStats);
+  ws->pStats = NULL;
+  ProgressJobEnd(ws->pProgress, job->szRelPath);
+  ws->pProgress = NULL;
+
+  return rc;
+}
+
+// Account the result of MigrateJob, in the original order
+static int RetireMigrateJob(void *arg, int rc) {
+  MIGRATEJOB *job = arg;
+  MIGRATE *mig = job->mig;
+  const char *pszFileName;
+
+  AddExecTime(mig);
+
+  // Show the name just like MigrateZip would
+  pszFileName = strrchr(job->szRelPath, DIRSEP);
+  if (pszFileName != job->szRelPath + 1 || job->szRelPath[0] != '.')
+    pszFileName = job->szRelPath;
+  else
+    pszFileName++;
 
-    snprintf(FileNameArray[iCount], MAX_PATH + 1, "%s", direntp->d_name);
-    iCount++;
+  if (job->bCached) {
+    job->iStatus = STATUS_OK;
+    if (qProgress) {
+      ProgressJobStart(&job->Progress, job->st.st_size);
+      ProgressJobEnd(&job->Progress, job->szRelPath);
+    }
+    if (!qQuietMode && !qCheckOnly)
+      logprint(stdout, mig->fProcessLog,
+               "Skipping, already TorrentZipped - %s\n", pszFileName);
+    rc = TZ_SKIPPED;
+  } else if (StatusCache) {
+    if (rc == TZ_SKIPPED || (rc == TZ_OK && !qCheckOnly)) {
+      if (StatusCacheSet(StatusCache, &job->st, job->crc,
+                         qStripSubdirs ? CACHE_STRIPPED : 0) != TZ_OK) {
+        logprint(stderr, mig->fProcessLog, "Error allocating memory!\n");
+        rc = TZ_CRITICAL;
+      }
+    } else if (rc != TZ_CRITICAL) {
+      StatusCacheForget(StatusCache, &job->st);
+    }
   }
 
-  FileNameArray[iCount][0] = 0;
+  if (qCheckOnly && rc != TZ_CRITICAL)
+    logprint(stdout, NULL, "%s\t%s\n", StatusName(job->iStatus), pszFileName);
+
+  if (Stats && rc != TZ_CRITICAL &&
+      StatsAdd(Stats, pszFileName, ResultName(rc, job->bCached),
+               StatusName(job->iStatus), &job->Stats) != TZ_OK) {
+    logprint(stderr, mig->fProcessLog, "Error allocating memory!\n");
+    rc = TZ_CRITICAL;
+  }
 
-  // Sort the dynamic array into canonical order
-  qsort(FileNameArray, iCount, sizeof(char *), StringCompare);
+  free(job);
 
-  return (FileNameArray);
+  switch (rc) {
+  case TZ_OK:
+    mig->cRezippedZips++;
+    break;
+  case TZ_ERR:
+    mig->cErrorZips++;
+    mig->bErrorEncountered = 1;
+    break;
+  case TZ_CRITICAL:
+    return TZ_CRITICAL;
+  case TZ_SKIPPED:
+    mig->cOkayZips++;
+  }
+
+  return TZ_OK;
 }
 
 // Function to convert a dir or zip
 static int RecursiveMigrate(const char *pszRelPath, const struct stat *pstat,
                             WORKSPACE *ws, MIGRATE *mig) {
   int rc = 0;
+  size_t len;
+  MIGRATEJOB *job;
 
-  char szRelPathBuf[MAX_PATH + 1];
-  const char *pszFileName = NULL;
+  if (S_ISDIR(pstat->st_mode))
+    return WalkMigrateDir(pszRelPath, ws, 0);
 
-  pszFileName = strrchr(pszRelPath, DIRSEP);
-  if (pszFileName) {
-    memcpy(szRelPathBuf, pszRelPath, pszFileName - pszRelPath);
-    szRelPathBuf[pszFileName - pszRelPath] = 0;
-    pszFileName++;
-  } else {
-    snprintf(szRelPathBuf, sizeof(szRelPathBuf), ".");
-    pszFileName = pszRelPath;
-  }
+  // if (S_ISREG(pstat->st_mode))? Users get what they ask for.
+  mig->cEncounteredZips++;
 
-  if (S_ISDIR(pstat->st_mode)) {
-    // Get our execution time (in seconds)
-    // for the conversion process so far
-    mig->ExecTime += difftime(time(NULL), mig->StartTime);
+  // Nothing but the report goes to stdout when checking
+  if (!mig->fProcessLog && !qCheckOnly) {
+    char szRelPathBuf[MAX_PATH + 1];
+    const char *pszFileName = strrchr(pszRelPath, DIRSEP);
 
-    rc = RecursiveMigrateDir(pszRelPath, ws);
+    if (pszFileName) {
+      memcpy(szRelPathBuf, pszRelPath, pszFileName - pszRelPath);
+      szRelPathBuf[pszFileName - pszRelPath] = 0;
+      pszFileName++;
+    } else {
+      snprintf(szRelPathBuf, sizeof(szRelPathBuf), ".");
+      pszFileName = pszRelPath;
+    }
 
-    // Restart the timing for this instance of RecursiveMigrate()
-    mig->StartTime = time(NULL);
-  } else { // if (S_ISREG(pstat->st_mode))? Users get what they ask for.
-    mig->cEncounteredZips++;
+    if (strcmp(szRelPathBuf, ".") == 0)
+      rc = OpenProcessLog(ws->pszLogDir, pszFileName, mig);
+    else
+      rc = OpenProcessLog(ws->pszLogDir, szRelPathBuf, mig);
 
-    if (!mig->fProcessLog) {
-      if (strcmp(szRelPathBuf, ".") == 0)
-        rc = OpenProcessLog(ws->pszLogDir, pszFileName, mig);
-      else
-        rc = OpenProcessLog(ws->pszLogDir, szRelPathBuf, mig);
+    if (rc != TZ_OK)
+      return TZ_CRITICAL;
+  }
+
+  len = strlen(pszRelPath);
+  if (!(job = malloc(sizeof(MIGRATEJOB) + len))) {
+    PoolLogBegin();
+    logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
+              "Error allocating memory!\n");
+    PoolLogEnd();
+    return TZ_CRITICAL;
+  }
+  job->mig = mig;
+  job->st = *pstat;
+  job->iStatus = STATUS_ERROR;
+  job->crc = 0;
+  job->iOutPos = iOutPrefix;
+  memset(&job->Stats, 0, sizeof(ARCHIVESTATS));
+  memcpy(job->szRelPath, pszRelPath, len + 1);
+
+  // Archives which haven't changed since they were found to be fine don't
+  // even have to be opened, unless they have to be copied for -o
+  job->bCached = StatusCache && !qRevalidate && !qForceReZip && !pszOutDir &&
+                 StatusCacheLookup(StatusCache, pstat,
+                                   qStripSubdirs ? CACHE_STRIPPED : 0);
+
+  return PoolSubmit(job->bCached ? NULL : MigrateJob, RetireMigrateJob, job);
+}
+
+// Read the entries of the directory worth looking at into wd, in
+// canonical order. Regular files not named .zip are dropped right away,
+// so they are never stat()ed, and so are directories unless recursing.
+static int ReadWalkDir(WALKDIR *wd, DIR *dirp) {
+  struct dirent *direntp;
+  int cAlloc = 0, iType, i;
+  WALKENTRY *e;
 
-      if (rc != TZ_OK)
+  while ((direntp = readdir(dirp))) {
+    iType = WALK_UNKNOWN;
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+    if (direntp->d_type == DT_DIR)
+      iType = WALK_DIR;
+    else if (direntp->d_type == DT_REG)
+      iType = WALK_FILE;
+    else if (direntp->d_type != DT_UNKNOWN)
+      continue; // symlinks and such aren't followed
+#endif
+
+    if (!strcmp(direntp->d_name, ".") || !strcmp(direntp->d_name, ".."))
+      continue;
+    if (iType == WALK_DIR && qNoRecursion)
+      continue;
+    if (iType == WALK_FILE &&
+        !EndsWithCaseInsensitive(direntp->d_name, ".zip"))
+      continue;
+
+    if (wd->cEntries == cAlloc) {
+      cAlloc = cAlloc ? 2 * cAlloc : 64;
+      if (!(e = realloc(wd->Entries, cAlloc * sizeof(WALKENTRY))))
         return TZ_CRITICAL;
+      wd->Entries = e;
     }
 
-    // minimum size of an empty zip file is 22 bytes, non-empty 98 bytes
-    if (pstat->st_size >= 22) {
-      rc = MigrateZip(pszFileName, szRelPathBuf, ws, mig);
+    e = &wd->Entries[wd->cEntries];
+    if (StringTableAddName(&wd->Names, direntp->d_name,
+                           strlen(direntp->d_name), &e->iName) != TZ_OK)
+      return TZ_CRITICAL;
+    e->iType = iType;
+    wd->cEntries++;
+  }
 
-      switch (rc) {
-      case TZ_OK:
-        mig->cRezippedZips++;
-        break;
-      case TZ_ERR:
-        mig->cErrorZips++;
-        mig->bErrorEncountered = 1;
-        break;
-      case TZ_CRITICAL:
-        break;
-      case TZ_SKIPPED:
-        mig->cOkayZips++;
-      }
-    } else { // Too small to be a valid zip file.
-      if (pstat->st_size)
-        logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
-                  "\"%s\" is too small (%d byte%s). File may be corrupt.\n",
-                  pszRelPath, (int)pstat->st_size,
-                  pstat->st_size == 1 ? "" : "s");
-      else
-        logprint3(stderr, mig->fProcessLog, ErrorLog(ws),
-                  "\"%s\" is empty. Skipping.\n", pszRelPath);
-      mig->cErrorZips++;
-      mig->bErrorEncountered = 1;
-    }
+  for (i = 0; i < wd->cEntries; i++)
+    SortNameInit((SORTNAME *)&wd->Entries[i],
+                 StringTableString(&wd->Names, wd->Entries[i].iName), 0);
+
+  // Sort the entries into canonical order
+  qsort(wd->Entries, wd->cEntries, sizeof(WALKENTRY), SortNameCompare);
+
+  return TZ_OK;
+}
+
+// Make pszPath (the path of the directory on top of the stack, followed
+// by DIRSEP unless it is ".") end in pszName
+static int WalkPath(WALK *w, const char *pszName) {
+  size_t cchDir = w->Dirs[w->cDirs - 1].cchPath;
+  size_t cb = cchDir + strlen(pszName) + 2;
+  char *p;
+
+  if (cb > w->cbPath) {
+    if (!(p = realloc(w->pszPath, cb)))
+      return TZ_CRITICAL;
+    w->pszPath = p;
+    w->cbPath = cb;
   }
+  strcpy(w->pszPath + cchDir, pszName);
 
-  return rc == TZ_CRITICAL ? TZ_CRITICAL : TZ_OK;
+  return TZ_OK;
 }
 
-// Function to convert the contents of a directory.
-// This function only receives directories, not files or zips.
-int RecursiveMigrateDir(const char *pszRelPath, WORKSPACE *ws) {
-  int rc = 0;
+// Remember pszDir as one of the directories for IsOwnDir
+static void AddOwnDir(const char *pszDir) {
+  if (!stat(pszDir, &OwnDirs[cOwnDirs]))
+    cOwnDirs++;
+}
 
-  char szTmpBuf[MAX_PATH + 1];
-  int iElements = 0;
-  char **FileNameArray = NULL;
-  int iCounter = 0;
-  int FileNameStartPos;
+// Whether the open directory at pszPath is the one of -o or -t
+static int IsOwnDir(DIR *dirp, const char *pszPath) {
+#ifdef WIN32
+  // There are no inode numbers to go by
+  (void)dirp;
+  (void)pszPath;
+  return 0;
+#else
+  struct stat st;
+  int i;
 
+  if (!cOwnDirs)
+    return 0;
+#ifdef WALK_AT
+  (void)pszPath;
+  if (fstat(dirfd(dirp), &st))
+    return 0;
+#else
+  (void)dirp;
+  if (stat(pszPath, &st))
+    return 0;
+#endif
+  for (i = 0; i < cOwnDirs; i++)
+    if (st.st_dev == OwnDirs[i].st_dev && st.st_ino == OwnDirs[i].st_ino)
+      return 1;
+  return 0;
+#endif
+}
+
+// Start on the directory at w->pszPath, named pszName in the directory
+// on top of the stack (if any)
+static int PushWalkDir(WALK *w, const char *pszName, WORKSPACE *ws) {
+  WALKDIR *wd;
   DIR *dirp = NULL;
-  MIGRATE mig = {0};
+  uint64_t nsStart = Stats ? StatsClock() : 0;
+  int rc;
 
-  // Get our start time for the conversion process of this dir/zip
-  mig.StartTime = time(NULL);
+  if (w->cDirs == w->cAlloc) {
+    int cAlloc = w->cAlloc ? 2 * w->cAlloc : 16;
+    if (!(wd = realloc(w->Dirs, cAlloc * sizeof(WALKDIR)))) {
+      PoolLogBegin();
+      logprint(stderr, ErrorLog(ws), "Error allocating memory!\n");
+      PoolLogEnd();
+      return TZ_CRITICAL;
+    }
+    w->Dirs = wd;
+    w->cAlloc = cAlloc;
+  }
 
-  // Couldn't access specified path
-  dirp = opendir(pszRelPath);
-  if (!dirp) {
+#ifdef WALK_AT
+  {
+    // Relative to the parent, so the path length doesn't matter. Symlinks
+    // are only followed for the directory given on the command line.
+    int fd = openat(w->cDirs ? dirfd(w->Dirs[w->cDirs - 1].dirp) : AT_FDCWD,
+                    w->cDirs ? pszName : w->pszPath,
+                    O_RDONLY | O_DIRECTORY | (w->cDirs ? O_NOFOLLOW : 0));
+    if (fd >= 0 && !(dirp = fdopendir(fd)))
+      close(fd);
+  }
+#else
+  (void)pszName;
+  dirp = opendir(w->pszPath);
+#endif
+
+  // Our own output found below an input is left alone
+  if (dirp && w->cDirs && IsOwnDir(dirp, w->pszPath)) {
+    closedir(dirp);
+    return TZ_OK;
+  }
+
+  wd = &w->Dirs[w->cDirs];
+  memset(wd, 0, sizeof(WALKDIR));
+  if (!w->bCount && !(wd->mig = BeginMigrateSummary(ws))) {
+    if (dirp)
+      closedir(dirp);
+    return TZ_CRITICAL;
+  }
+
+  if (!dirp && !w->bCount) {
+    PoolLogBegin();
     logprint(stderr, ErrorLog(ws), "Could not access subdir \"%s\"! %s\n",
-             pszRelPath, strerror(errno));
-    mig.bErrorEncountered = 1;
+             w->pszPath, strerror(errno));
+    PoolLogEnd();
+    wd->mig->bErrorEncountered = 1;
+  }
+
+  // The directory goes on the stack even if it can't be read, so its
+  // summary comes out in order. Paths below "." don't start with "./".
+  if (strcmp(w->pszPath, ".") == 0) {
+    wd->cchPath = 0;
   } else {
-    FileNameArray = GetDirFileList(dirp, &iElements);
-    closedir(dirp);
+    wd->cchPath = strlen(w->pszPath);
+    w->pszPath[wd->cchPath++] = DIRSEP;
+  }
+  w->cDirs++;
 
-    if (!FileNameArray) {
-      logprint(stderr, ErrorLog(ws), "Error allocating memory!\n");
-      rc = TZ_CRITICAL;
-    } else {
-      if (strcmp(pszRelPath, ".") == 0) {
-        szTmpBuf[0] = 0;
-        FileNameStartPos = 0;
-      } else {
-        FileNameStartPos =
-            snprintf(szTmpBuf, sizeof(szTmpBuf), "%s%c", pszRelPath, DIRSEP);
-      }
+  if (!dirp)
+    return TZ_OK;
 
-      for (iCounter = 0; (iCounter < iElements && FileNameArray[iCounter][0]);
-           iCounter++) {
-        struct stat istat;
+  rc = ReadWalkDir(wd, dirp);
+#ifdef WALK_AT
+  wd->dirp = dirp; // needed for the entries
+#else
+  closedir(dirp);
+#endif
+  if (Stats)
+    StatsAddScan(Stats, StatsClock() - nsStart);
 
-        // Construct full path
-        snprintf(szTmpBuf + FileNameStartPos,
-                 sizeof(szTmpBuf) - FileNameStartPos, "%s",
-                 FileNameArray[iCounter]);
+  if (rc != TZ_OK) {
+    PoolLogBegin();
+    logprint(stderr, ErrorLog(ws), "Error allocating memory!\n");
+    PoolLogEnd();
+  }
 
-        // Don't follow symlinks during recursion
-        if (lstat(szTmpBuf, &istat)) {
-          logprint3(stderr, mig.fProcessLog, ErrorLog(ws),
-                    "Could not stat \"%s\". %s\n", szTmpBuf, strerror(errno));
-          continue;
-        }
+  return rc;
+}
 
-        // Only process regular .zip files and directories (unless recursion is
-        // disabled). Skip other files right here.
-        if (S_ISDIR(istat.st_mode)) {
-          if (qNoRecursion || !strcmp(FileNameArray[iCounter], ".") ||
-              !strcmp(FileNameArray[iCounter], ".."))
-            continue;
-        } else if (!S_ISREG(istat.st_mode) ||
-                   !EndsWithCaseInsensitive(FileNameArray[iCounter], ".zip")) {
-          continue;
-        }
+// Finish the directory on top of the stack
+static int PopWalkDir(WALK *w, int rc) {
+  WALKDIR *wd = &w->Dirs[--w->cDirs];
 
-        rc = RecursiveMigrate(szTmpBuf, &istat, ws, &mig);
-        if (rc == TZ_CRITICAL)
-          break;
+#ifdef WALK_AT
+  if (wd->dirp)
+    closedir(wd->dirp);
+#endif
+  free(wd->Entries);
+  StringTableFree(&wd->Names);
+
+  return wd->mig ? EndMigrateSummary(wd->mig, rc) : rc;
+}
+
+// Function to convert the contents of a directory and everything below.
+// This function only receives directories, not files or zips. It walks
+// the tree with a stack instead of recursing, depth first and in
+// canonical order. With bCount the archives are only counted for -u,
+// leaving reporting problems to the real walk.
+static int WalkMigrateDir(const char *pszRelPath, WORKSPACE *ws, int bCount) {
+  WALK w;
+  WALKDIR *wd;
+  WALKENTRY *e;
+  struct stat istat;
+  uint64_t nsStart;
+  int rc = TZ_OK, err;
+
+  memset(&w, 0, sizeof(w));
+  w.cbPath = strlen(pszRelPath) + 2;
+  if (!(w.pszPath = malloc(w.cbPath))) {
+    PoolLogBegin();
+    logprint(stderr, ErrorLog(ws), "Error allocating memory!\n");
+    PoolLogEnd();
+    return TZ_CRITICAL;
+  }
+  strcpy(w.pszPath, pszRelPath);
+  w.bCount = bCount;
+
+  rc = PushWalkDir(&w, NULL, ws);
+
+  while (w.cDirs && rc != TZ_CRITICAL) {
+    wd = &w.Dirs[w.cDirs - 1];
+    if (wd->iNext == wd->cEntries) {
+      rc = PopWalkDir(&w, rc);
+      continue;
+    }
+    e = &wd->Entries[wd->iNext++];
+
+    if ((rc = WalkPath(&w, e->pszName)) != TZ_OK) {
+      PoolLogBegin();
+      logprint(stderr, ErrorLog(ws), "Error allocating memory!\n");
+      PoolLogEnd();
+      break;
+    }
+
+    // Directories known from readdir go without stat()
+    if (e->iType != WALK_DIR) {
+      nsStart = Stats ? StatsClock() : 0;
+      // Don't follow symlinks during recursion
+#ifdef WALK_AT
+      err = fstatat(dirfd(wd->dirp), e->pszName, &istat, AT_SYMLINK_NOFOLLOW);
+#else
+      err = lstat(w.pszPath, &istat);
+#endif
+      if (Stats)
+        StatsAddScan(Stats, StatsClock() - nsStart);
+      if (err && bCount)
+        continue;
+      if (err) {
+        PoolLogBegin();
+        logprint3(stderr, wd->mig->fProcessLog, ErrorLog(ws),
+                  "Could not stat \"%s\". %s\n", w.pszPath, strerror(errno));
+        PoolLogEnd();
+        continue;
+      }
+
+      // Only process regular .zip files and directories (unless recursion
+      // is disabled). Skip other files right here.
+      if (S_ISDIR(istat.st_mode)) {
+        if (qNoRecursion)
+          continue;
+      } else if (!S_ISREG(istat.st_mode) ||
+                 !EndsWithCaseInsensitive(e->pszName, ".zip")) {
+        continue;
       }
     }
 
-    DynamicStringArrayDestroy(FileNameArray, iElements);
+    if (e->iType == WALK_DIR || S_ISDIR(istat.st_mode)) {
+      rc = PushWalkDir(&w, e->pszName, ws);
+    } else if (bCount) {
+      if (strlen(w.pszPath) <= MAX_PATH)
+        ProgressAddArchive(istat.st_size);
+    } else if (strlen(w.pszPath) > MAX_PATH) {
+      PoolLogBegin();
+      logprint3(stderr, wd->mig->fProcessLog, ErrorLog(ws),
+                "Path \"%s\" is too long. Skipping.\n", w.pszPath);
+      PoolLogEnd();
+      wd->mig->bErrorEncountered = 1;
+    } else {
+      rc = RecursiveMigrate(w.pszPath, &istat, ws, wd->mig);
+    }
   }
 
-  // Get our execution time (in seconds) for the conversion process
-  mig.ExecTime += difftime(time(NULL), mig.StartTime);
+  // Unwind after a critical error
+  while (w.cDirs)
+    PopWalkDir(&w, TZ_CRITICAL);
 
-  if (rc != TZ_CRITICAL)
-    DisplayMigrateSummary(ws, &mig);
-  if (rc != TZ_OK || mig.bErrorEncountered)
-    qErrors = 1;
-  if (mig.fProcessLog)
-    fclose(mig.fProcessLog);
+  free(w.Dirs);
+  free(w.pszPath);
+
+  return rc;
+}
+
+// Allocate the statistics for a directory or command line argument
+static MIGRATE *BeginMigrateSummary(WORKSPACE *ws) {
+  MIGRATESUMMARY *sum = calloc(1, sizeof(MIGRATESUMMARY));
+
+  if (!sum) {
+    PoolLogBegin();
+    logprint(stderr, ErrorLog(ws), "Error allocating memory!\n");
+    PoolLogEnd();
+    return NULL;
+  }
+  sum->ws = ws;
+
+  return &sum->mig;
+}
+
+// Queue the summary behind everything submitted for mig so far
+static int EndMigrateSummary(MIGRATE *mig, int rc) {
+  MIGRATESUMMARY *sum = (MIGRATESUMMARY *)mig;
+
+  sum->rc = rc;
+  if (PoolSubmit(NULL, RetireMigrateSummary, sum) == TZ_CRITICAL)
+    rc = TZ_CRITICAL;
 
   return rc == TZ_CRITICAL ? TZ_CRITICAL : TZ_OK;
 }
 
+static int RetireMigrateSummary(void *arg, int rc) {
+  MIGRATESUMMARY *sum = arg;
+  MIGRATE *mig = &sum->mig;
+
+  (void)rc;
+  AddExecTime(mig);
+
+  if (sum->rc != TZ_CRITICAL && !PoolFailed())
+    DisplayMigrateSummary(sum->ws, mig);
+  if (sum->rc != TZ_OK || mig->bErrorEncountered)
+    qErrors = 1;
+  if (mig->fProcessLog)
+    fclose(mig->fProcessLog);
+  free(sum);
+
+  return TZ_OK;
+}
+
+// Account the wall clock time since the last retirement to mig
+static void AddExecTime(MIGRATE *mig) {
+  time_t now = time(NULL);
+
+  mig->ExecTime += difftime(now, LastRetireTime);
+  LastRetireTime = now;
+}
+
+// Name of a STATUS_... code in the -c report
+static const char *StatusName(int iStatus) {
+  switch (iStatus) {
+  case STATUS_OK:
+    return "OK";
+  case STATUS_BAD_COMMENT:
+    return "BAD_COMMENT";
+  case STATUS_OUT_OF_DATE:
+    return "OUT_OF_DATE";
+  case STATUS_WRONG_ORDER:
+    return "WRONG_ORDER";
+  case STATUS_CONTAINS_DIRS:
+    return "CONTAINS_DIRS";
+  default:
+    return "ERROR";
+  }
+}
+
+// What was done with an archive, for -i
+static const char *ResultName(int rc, int bCached) {
+  switch (rc) {
+  case TZ_OK:
+    return qCheckOnly ? "checked" : "rezipped";
+  case TZ_SKIPPED:
+    return bCached ? "cached" : qCheckOnly ? "checked" : "skipped";
+  default:
+    return "error";
+  }
+}
+
 void DisplayMigrateSummary(WORKSPACE *ws, MIGRATE *mig) {
   double ExecTime;
 
@@ -901,15 +1623,15 @@ int RecursiveMigrateTop(const char *pszRelPath, WORKSPACE *ws) {
   char szRelPathBuf[MAX_PATH + 1];
   int n;
   struct stat istat;
-  MIGRATE mig = {0};
-
-  mig.StartTime = time(NULL);
+  MIGRATE *mig;
 
   // Follow symlinks for direct command line arguments. Process any file
   // regardless of type and name.
   if (stat(pszRelPath, &istat)) {
+    PoolLogBegin();
     logprint(stderr, ErrorLog(ws), "Could not stat \"%s\". %s\n", pszRelPath,
              strerror(errno));
+    PoolLogEnd();
     qErrors = 1;
     return TZ_ERR;
   }
@@ -921,26 +1643,57 @@ int RecursiveMigrateTop(const char *pszRelPath, WORKSPACE *ws) {
     pszRelPath = szRelPathBuf;
   }
 
-  rc = RecursiveMigrate(pszRelPath, &istat, ws, &mig);
+  // -o mirrors what is below a directory argument, a file goes right
+  // into the output directory
+  if (S_ISDIR(istat.st_mode)) {
+    iOutPrefix = strcmp(pszRelPath, ".") ? (int)strlen(pszRelPath) + 1 : 0;
+  } else {
+    const char *pszFileName = strrchr(pszRelPath, DIRSEP);
+    iOutPrefix = pszFileName ? (int)(pszFileName - pszRelPath) + 1 : 0;
+  }
 
-  // Get our execution time (in seconds) for the conversion process
-  mig.ExecTime += difftime(time(NULL), mig.StartTime);
+  if (!(mig = BeginMigrateSummary(ws)))
+    return TZ_CRITICAL;
 
-  if (rc != TZ_CRITICAL)
-    DisplayMigrateSummary(ws, &mig);
-  if (rc != TZ_OK || mig.bErrorEncountered)
-    qErrors = 1;
-  if (mig.fProcessLog)
-    fclose(mig.fProcessLog);
+  rc = RecursiveMigrate(pszRelPath, &istat, ws, mig);
 
-  return rc == TZ_CRITICAL ? TZ_CRITICAL : TZ_OK;
+  return EndMigrateSummary(mig, rc);
+}
+
+// Count the archives RecursiveMigrateTop will find, for -u
+static int CountArchives(const char *pszRelPath, WORKSPACE *ws) {
+  char szRelPathBuf[MAX_PATH + 1];
+  struct stat istat;
+  int n;
+
+  // Whatever is wrong gets reported when processing it
+  if (stat(pszRelPath, &istat))
+    return TZ_OK;
+  if (!S_ISDIR(istat.st_mode)) {
+    ProgressAddArchive(istat.st_size);
+    return TZ_OK;
+  }
+
+  n = strlen(pszRelPath);
+  if (n > 0 && pszRelPath[n - 1] == DIRSEP) {
+    snprintf(szRelPathBuf, sizeof(szRelPathBuf), "%s", pszRelPath);
+    szRelPathBuf[n - 1] = 0;
+    pszRelPath = szRelPathBuf;
+  }
+
+  return WalkMigrateDir(pszRelPath, ws, 1);
 }
 
 int main(int argc, char **argv) {
   WORKSPACE *ws;
-  const char *logdir = NULL, *errlog = NULL;
+  const char *logdir = NULL, *errlog = NULL, *cachefile = NULL;
+  const char *streamdir = NULL, *statsfile = NULL;
+  ZPOS64_T cbStreamCache = 1024;
+  int iSlowest = 0;
+  int iProgressSeconds = 0;
   int iCount = 0;
   int iOptionsFound = 0;
+  int iThreads = 1;
   int rc = 0;
 
   for (iCount = 1; iCount < argc; iCount++) {
@@ -957,20 +1710,48 @@ int main(int argc, char **argv) {
             "\tStatMat, shindakun, Ultrasubmarine, r3nh03k, goosecreature, "
             "gordonj,\n\t0-wiz-0, A.Miller\n"
             "Homepage: https://github.com/0-wiz-0/trrntzip\n\n"
-            "Usage: trrntzip [-dfghqsv] [-e[FILE]] [-l[DIR]] [ZIPFILE|DIRECTORY]\n\n"
+            "Usage: trrntzip [-cdfghpqrsv] [-bN] [-e[FILE]] [-iFILE] [-j[N]] [-kFILE] [-l[DIR]] [-mN] [-nN] [-oDIR] [-tDIR] [-u[N]] [-wN] [-zDIR] [ZIPFILE|DIRECTORY]\n\n"
             "Convert a zip archive (or each zip archive in a directory) to torrentzip format.\n\n"
             "Options:\n"
             "\t-h\t: show this help\n"
+            "\t-bN\t: limit the stream cache from -z to N MB (default: 1024)\n"
+            "\t-c\t: only report the status of each zip, don't change anything\n"
             "\t-d\t: strip sub-directories from zips\n"
             "\t-eFILE\t: write error log to FILE (empty to disable)\n"
             "\t-f\t: force re-zip\n"
             "\t-g\t: skip interactive prompts\n"
+            "\t-iFILE\t: write timings and sizes of each archive to FILE as JSON lines (CSV if named .csv, - for stdout)\n"
+            "\t-jN\t: process N archives in parallel (default: number of CPUs)\n"
+            "\t-kFILE\t: remember TorrentZipped archives in FILE and skip them while unchanged\n"
             "\t-lDIR\t: write log files in DIR (empty to disable)\n"
+            "\t-mN\t: use up to N threads for the members of an archive, compressing at most 256 MB ahead (members of 1 MB or more are always inflated on a thread of their own)\n"
+            "\t-nN\t: show the N slowest archives at the end\n"
+            "\t-oDIR\t: write the zips to the same paths below DIR instead of replacing them\n"
+            "\t-p\t: read archives with stdio instead of mapping them into memory\n"
             "\t-q\t: quiet mode\n"
+            "\t-r\t: check archives again even if FILE from -k lists them\n"
             "\t-s\t: prevent sub-directory recursion\n"
-            "\t-v\t: show version\n");
+            "\t-tDIR\t: create temporary files in DIR\n"
+            "\t-uN\t: show progress with an estimate of the time left every N seconds (default: 1, 10 if not a terminal)\n"
+            "\t-v\t: show version\n"
+            "\t-wN\t: build zips smaller than N MB in memory before writing them (default: 8)\n"
+            "\t-zDIR\t: keep compressed members in DIR and reuse them for identical files\n");
         return EXIT_SUCCESS;
 
+      case 'b':
+        // Stream cache size limit in MB
+        cbStreamCache = strtoull(&argv[iCount][2], NULL, 10);
+        if (!cbStreamCache) {
+          fprintf(stderr, "Invalid cache size : %s\n", argv[iCount]);
+          return EXIT_FAILURE;
+        }
+        break;
+
+      case 'c':
+        // Report status only
+        qCheckOnly = 1;
+        break;
+
       case 'd':
         // Strip subdirs from zips
         qStripSubdirs = 1;
@@ -991,26 +1772,111 @@ int main(int argc, char **argv) {
         qGUILaunch = 1;
         break;
 
+      case 'i':
+        // Statistics file
+        statsfile = &argv[iCount][2];
+        break;
+
+      case 'j':
+        // Number of parallel workers
+        if (argv[iCount][2]) {
+          iThreads = atoi(&argv[iCount][2]);
+          if (iThreads < 1) {
+            fprintf(stderr, "Invalid number of jobs : %s\n", argv[iCount]);
+            return EXIT_FAILURE;
+          }
+        } else {
+#ifdef _SC_NPROCESSORS_ONLN
+          iThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        }
+        break;
+
+      case 'k':
+        // Status cache file
+        cachefile = &argv[iCount][2];
+        break;
+
       case 'l':
         // Log directory
         logdir = &argv[iCount][2];
         break;
 
+      case 'm':
+        // Number of threads compressing members of one archive
+        iMemberThreads = atoi(&argv[iCount][2]);
+        if (iMemberThreads < 1) {
+          fprintf(stderr, "Invalid number of threads : %s\n", argv[iCount]);
+          return EXIT_FAILURE;
+        }
+        break;
+
+      case 'n':
+        // Number of slowest archives to show
+        iSlowest = atoi(&argv[iCount][2]);
+        if (iSlowest < 1) {
+          fprintf(stderr, "Invalid number of archives : %s\n", argv[iCount]);
+          return EXIT_FAILURE;
+        }
+        break;
+
+      case 'o':
+        // Output tree
+        pszOutDir = argv[iCount][2] ? &argv[iCount][2] : NULL;
+        break;
+
+      case 'p':
+        // Plain reads instead of memory maps
+        MapFileEnable(0);
+        break;
+
       case 'q':
         // Quiet mode - show less messages while running
         qQuietMode = 1;
         break;
 
+      case 'r':
+        // Ignore the status cache, but update it
+        qRevalidate = 1;
+        break;
+
       case 's':
         // Disable dir recursion
         qNoRecursion = 1;
         break;
 
+      case 't':
+        // Directory for temporary files
+        pszTmpDir = argv[iCount][2] ? &argv[iCount][2] : NULL;
+        break;
+
+      case 'u':
+        // Show progress, every N seconds
+        qProgress = 1;
+        if (argv[iCount][2]) {
+          iProgressSeconds = atoi(&argv[iCount][2]);
+          if (iProgressSeconds < 1) {
+            fprintf(stderr, "Invalid interval : %s\n", argv[iCount]);
+            return EXIT_FAILURE;
+          }
+        }
+        break;
+
       case 'v':
         // GUI requesting TZ version
         fprintf(stdout, "TorrentZip v%s\n", TZ_VERSION);
         return EXIT_SUCCESS;
 
+      case 'w':
+        // Largest zip built in memory in MB
+        cbMemZip = (ZPOS64_T)strtoull(&argv[iCount][2], NULL, 10) << 20;
+        break;
+
+      case 'z':
+        // Stream cache directory
+        streamdir = &argv[iCount][2];
+        break;
+
       default:
         fprintf(stderr, "Unknown option : %s\n", argv[iCount]);
       }
@@ -1020,7 +1886,7 @@ int main(int argc, char **argv) {
   if (argc < 2 || iOptionsFound == (argc - 1)) {
     fprintf(stderr, "trrntzip: missing path\n");
     fprintf(stderr,
-            "Usage: trrntzip [-dfghqsv] [-eFILE] [-lDIR] [PATH/ZIP FILE]\n");
+            "Usage: trrntzip [-cdfghpqrsv] [-bN] [-eFILE] [-iFILE] [-jN] [-kFILE] [-lDIR] [-mN] [-nN] [-oDIR] [-tDIR] [-uN] [-wN] [-zDIR] [PATH/ZIP FILE]\n");
 #ifdef WIN32
     // Prevent the command window from disappearing immediately when
     // the user just clicks on the exe.
@@ -1031,6 +1897,8 @@ int main(int argc, char **argv) {
     return EXIT_FAILURE;
   }
 
+  Crc32Init();
+
   ws = AllocateWorkspace();
 
   if (ws == NULL) {
@@ -1084,12 +1952,108 @@ int main(int argc, char **argv) {
   }
   rc = SetupErrorLog(ws, qGUILaunch);
 
+  if (rc == TZ_OK && cachefile && *cachefile) {
+    if (!(StatusCache = StatusCacheCreate(cachefile))) {
+      fprintf(stderr, "Error allocating memory!\n");
+      rc = TZ_CRITICAL;
+    } else {
+      rc = StatusCacheLoad(StatusCache);
+      if (rc == TZ_CRITICAL) {
+        fprintf(stderr, "Error allocating memory!\n");
+      } else if (rc != TZ_OK) {
+        // Don't overwrite what might not be a status cache at all
+        logprint(stderr, ErrorLog(ws),
+                 "Could not read status cache \"%s\", not using it. Remove "
+                 "it to start a new one.\n",
+                 cachefile);
+        StatusCacheFree(StatusCache);
+        StatusCache = NULL;
+        rc = TZ_OK;
+      }
+    }
+  }
+
+  // Nothing gets compressed when only checking
+  if (rc == TZ_OK && streamdir && *streamdir && !qCheckOnly) {
+    if (!(StreamCache = StreamCacheOpen(streamdir, cbStreamCache << 20)))
+      logprint(stderr, ErrorLog(ws),
+               "Could not open stream cache \"%s\", not using it. %s\n",
+               streamdir, strerror(errno));
+  }
+
+  if (rc == TZ_OK && ((statsfile && *statsfile) || iSlowest)) {
+    if (!(Stats = StatsCreate(statsfile && *statsfile ? statsfile : NULL,
+                              iSlowest))) {
+      logprint(stderr, ErrorLog(ws),
+               "Could not open statistics file \"%s\". %s\n", statsfile,
+               strerror(errno));
+      rc = TZ_ERR;
+    }
+  }
+
+  // The output directory is created up front, so the walker knows to
+  // skip it from the start if it is below an input
+  if (rc == TZ_OK && pszOutDir && !qCheckOnly) {
+    char szDir[MAX_PATH + 1];
+    snprintf(szDir, sizeof(szDir), "%s%c.", pszOutDir, DIRSEP);
+    MakeParentDirs(szDir);
+    AddOwnDir(pszOutDir);
+  }
+  if (rc == TZ_OK && pszTmpDir)
+    AddOwnDir(pszTmpDir);
+
   if (rc == TZ_OK) {
-    // Start process for each passed path/zip file
-    for (iCount = iOptionsFound + 1; iCount < argc; iCount++) {
+    rc = PoolStart(iThreads, ws);
+    if (rc != TZ_OK)
+      fprintf(stderr, "Could not start %d worker threads!\n", iThreads);
+  }
+
+  if (rc == TZ_OK) {
+    // Find out how much there is to do first, so the time left can be
+    // estimated
+    if (qProgress) {
+      ProgressStart(iProgressSeconds);
+      for (iCount = iOptionsFound + 1; iCount < argc; iCount++) {
+        rc = CountArchives(argv[iCount], ws);
+        if (rc == TZ_CRITICAL)
+          break;
+      }
+      ProgressRun();
+    }
+
+    LastRetireTime = time(NULL);
+
+    // Start process for each passed path/zip file. All of them share the
+    // same workers.
+    for (iCount = iOptionsFound + 1; iCount < argc && rc != TZ_CRITICAL;
+         iCount++) {
       rc = RecursiveMigrateTop(argv[iCount], ws);
-      if (rc == TZ_CRITICAL)
-        break;
+    }
+    if (PoolDrain() == TZ_CRITICAL)
+      rc = TZ_CRITICAL;
+    PoolStop();
+    ProgressEnd();
+
+    if (StatusCache) {
+      const char *pErr = StatusCacheSave(StatusCache);
+      if (pErr) {
+        logprint(stderr, ErrorLog(ws),
+                 "Could not write status cache \"%s\". %s\n", cachefile,
+                 pErr);
+        qErrors = 1;
+      }
+    }
+
+    if (Stats) {
+      const char *pErr = StatsClose(Stats);
+      if (pErr) {
+        logprint(stderr, ErrorLog(ws),
+                 "Could not write statistics file \"%s\". %s\n", statsfile,
+                 pErr);
+        qErrors = 1;
+      }
+      if (rc != TZ_CRITICAL)
+        StatsReport(Stats, qCheckOnly ? stderr : stdout);
     }
 
     if (qErrors) {
@@ -1112,6 +2076,12 @@ int main(int argc, char **argv) {
 #endif
   }
 
+  if (StatusCache)
+    StatusCacheFree(StatusCache);
+  if (StreamCache)
+    StreamCacheClose(StreamCache);
+  if (Stats)
+    StatsFree(Stats);
   FreeWorkspace(ws);
 
   return -rc; // Map TZ_... codes to EXIT_...
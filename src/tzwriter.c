@@ -0,0 +1,641 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "crc32.h"
+#include "global.h"
+#include "stats.h"
+#include "tzwriter.h"
+
+// minizip writes every header field with a call of its own, seeks back
+// into each local header once a member is done and keeps the central
+// directory in a list of small blocks. Everything TorrentZip writes is
+// fixed except for names, sizes, CRCs and offsets, so headers are filled
+// in from templates here, the central directory is one buffer, and its
+// CRC is updated as entries are added. Members already deflated get
+// complete local headers right away, and big chunks are written together
+// with the buffer in front of them, so a zip takes few and large writes.
+
+#define LOCAL_HEADER_SIZE 30
+#define CENTRAL_HEADER_SIZE 46
+#define ZIP64_EXTRA_SIZE 20        // ID, size and two 64 bit values
+#define ZIP64_CENTRAL_EXTRA_MAX 24 // up to three 64 bit values
+
+// 1996-12-24 23:32:00, MAME's first release date, in MS-DOS format
+#define TZ_DOS_DATE                                                            \
+  ((((1996 - 1980) << 9 | 12 << 5 | 24) << 16) | (23 << 11 | 32 << 5))
+
+#define TZ_FLAG 2 // maximum compression
+
+// The memLevel minizip deflates with, the output depends on it
+#if MAX_MEM_LEVEL >= 8
+#define TZ_MEM_LEVEL 8
+#else
+#define TZ_MEM_LEVEL MAX_MEM_LEVEL
+#endif
+
+static const unsigned char LocalHeader[LOCAL_HEADER_SIZE] = {
+    'P', 'K', 3, 4, 20, 0, TZ_FLAG, 0, Z_DEFLATED, 0,
+    TZ_DOS_DATE & 0xff, TZ_DOS_DATE >> 8 & 0xff, TZ_DOS_DATE >> 16 & 0xff,
+    TZ_DOS_DATE >> 24};
+
+// No file type (ASCII, BINARY) and no RASH (Read only, Archive, System,
+// Hidden) attributes
+static const unsigned char CentralHeader[CENTRAL_HEADER_SIZE] = {
+    'P', 'K', 1, 2, 0, 0, 20, 0, TZ_FLAG, 0, Z_DEFLATED, 0,
+    TZ_DOS_DATE & 0xff, TZ_DOS_DATE >> 8 & 0xff, TZ_DOS_DATE >> 16 & 0xff,
+    TZ_DOS_DATE >> 24};
+
+struct _TZWRITER {
+  int fd;
+  unsigned char *pBuf; // output not written to fd yet
+  size_t cbBuf;
+  size_t cbBufAlloc;
+  ZPOS64_T posBuf; // file offset of pBuf
+  unsigned char *pCentral;
+  size_t cbCentral;
+  size_t cbCentralAlloc;
+  uLong crcCentral;
+  ZPOS64_T cEntries;
+
+  z_stream *zs; // the caller's, only used while a member is open
+
+  // The member being written
+  int bOpen;
+  int bRaw; // already deflated, its local header is complete
+  int bZip64;
+  size_t cchName;
+  ZPOS64_T posHeader;
+  ZPOS64_T cCompressed;
+  ZPOS64_T cUncompressed;
+  ZPOS64_T cCompressedRaw; // what a raw member was opened with
+  uLong crcRaw;
+
+  uint64_t *pnsWrite; // see TzWriterCount
+  uint64_t *pcbWritten;
+};
+
+// Part of the output, for WriteChunks
+typedef struct _CHUNK {
+  const unsigned char *p;
+  size_t cb;
+} CHUNK;
+
+#define MAX_CHUNKS 4
+
+// Store x in little endian order, or all ones if it doesn't fit (like
+// minizip does)
+static void PutValue(unsigned char *p, ZPOS64_T x, int cb) {
+  int i;
+
+  for (i = 0; i < cb; i++, x >>= 8)
+    p[i] = (unsigned char)(x & 0xff);
+  if (x)
+    memset(p, 0xff, cb);
+}
+
+#ifdef WIN32
+static int WriteAll(int fd, const unsigned char *p, size_t cb) {
+  int cbWritten;
+
+  while (cb) {
+    cbWritten = write(fd, p, cb < 0x40000000 ? (unsigned)cb : 0x40000000u);
+    if (cbWritten < 0) {
+      if (errno == EINTR)
+        continue;
+      return ZIP_ERRNO;
+    }
+    p += cbWritten;
+    cb -= cbWritten;
+  }
+
+  return ZIP_OK;
+}
+#endif
+
+// Start timing a write for TzWriterCount
+static uint64_t WriteStart(const TZWRITER *tw) {
+  return tw->pnsWrite ? StatsClock() : 0;
+}
+
+static void WriteDone(TZWRITER *tw, uint64_t nsStart, ZPOS64_T cbWritten) {
+  if (tw->pnsWrite) {
+    *tw->pnsWrite += StatsClock() - nsStart;
+    *tw->pcbWritten += cbWritten;
+  }
+}
+
+// Write up to MAX_CHUNKS chunks in order with as few calls as possible.
+// On network file systems each one is a round trip.
+static int WriteChunks(TZWRITER *tw, CHUNK *chunks, int cChunks) {
+  uint64_t nsStart = WriteStart(tw);
+  ZPOS64_T posStart = tw->posBuf;
+#ifdef WIN32
+  int i;
+
+  for (i = 0; i < cChunks; i++) {
+    if (WriteAll(tw->fd, chunks[i].p, chunks[i].cb) != ZIP_OK)
+      return ZIP_ERRNO;
+    tw->posBuf += chunks[i].cb;
+  }
+#else
+  struct iovec iov[MAX_CHUNKS];
+  size_t cbTotal, cb;
+  ssize_t cbWritten;
+  int i;
+
+  while (cChunks) {
+    if (!chunks->cb) {
+      chunks++;
+      cChunks--;
+      continue;
+    }
+
+    // Some systems refuse writes adding up to more than 2 GB
+    for (i = 0, cbTotal = 0; i < cChunks && cbTotal < 0x40000000; i++) {
+      iov[i].iov_base = (void *)(uintptr_t)chunks[i].p;
+      iov[i].iov_len = chunks[i].cb < 0x40000000 - cbTotal
+                           ? chunks[i].cb
+                           : 0x40000000 - cbTotal;
+      cbTotal += iov[i].iov_len;
+    }
+
+    cbWritten = writev(tw->fd, iov, i);
+    if (cbWritten < 0) {
+      if (errno == EINTR)
+        continue;
+      return ZIP_ERRNO;
+    }
+    tw->posBuf += cbWritten;
+
+    for (; cbWritten > 0; cbWritten -= cb) {
+      cb = chunks->cb < (size_t)cbWritten ? chunks->cb : (size_t)cbWritten;
+      chunks->p += cb;
+      chunks->cb -= cb;
+      if (!chunks->cb) {
+        chunks++;
+        cChunks--;
+      }
+    }
+  }
+#endif
+
+  WriteDone(tw, nsStart, tw->posBuf - posStart);
+
+  return ZIP_OK;
+}
+
+static int Flush(TZWRITER *tw) {
+  CHUNK chunk;
+
+  chunk.p = tw->pBuf;
+  chunk.cb = tw->cbBuf;
+  tw->cbBuf = 0;
+
+  return WriteChunks(tw, &chunk, 1);
+}
+
+static int Put(TZWRITER *tw, const void *pData, size_t cbData) {
+  const unsigned char *p = pData;
+  CHUNK chunks[2];
+  size_t cb;
+
+  // Big chunks aren't copied, they go out right behind the buffer
+  if (cbData >= tw->cbBufAlloc) {
+    chunks[0].p = tw->pBuf;
+    chunks[0].cb = tw->cbBuf;
+    chunks[1].p = p;
+    chunks[1].cb = cbData;
+    tw->cbBuf = 0;
+    return WriteChunks(tw, chunks, 2);
+  }
+
+  while (cbData) {
+    if (tw->cbBuf == tw->cbBufAlloc && Flush(tw) != ZIP_OK)
+      return ZIP_ERRNO;
+    cb = tw->cbBufAlloc - tw->cbBuf;
+    if (cb > cbData)
+      cb = cbData;
+    memcpy(tw->pBuf + tw->cbBuf, p, cb);
+    tw->cbBuf += cb;
+    p += cb;
+    cbData -= cb;
+  }
+
+  return ZIP_OK;
+}
+
+// Overwrite already written output at pos, in the buffer or in the file
+static int PutAt(TZWRITER *tw, ZPOS64_T pos, const unsigned char *p,
+                 size_t cb) {
+  size_t cbFile = 0;
+  int rc = ZIP_OK;
+
+  if (pos < tw->posBuf) {
+    uint64_t nsStart = WriteStart(tw);
+    cbFile = tw->posBuf - pos < cb ? (size_t)(tw->posBuf - pos) : cb;
+#ifdef WIN32
+    if (_lseeki64(tw->fd, pos, SEEK_SET) < 0 ||
+        WriteAll(tw->fd, p, cbFile) != ZIP_OK ||
+        _lseeki64(tw->fd, tw->posBuf, SEEK_SET) < 0)
+      rc = ZIP_ERRNO;
+#else
+    if (pwrite(tw->fd, p, cbFile, pos) != (ssize_t)cbFile)
+      rc = ZIP_ERRNO;
+#endif
+    WriteDone(tw, nsStart, 0);
+    pos += cbFile;
+  }
+  memcpy(tw->pBuf + (pos - tw->posBuf), p + cbFile, cb - cbFile);
+
+  return rc;
+}
+
+// Make room for cb more bytes of central directory
+static int CentralReserve(TZWRITER *tw, size_t cb) {
+  size_t cbAlloc = tw->cbCentralAlloc;
+  unsigned char *p;
+
+  if (cb <= cbAlloc - tw->cbCentral)
+    return ZIP_OK;
+
+  while (cb > cbAlloc - tw->cbCentral) {
+    if (cbAlloc > (size_t)-1 / 2) {
+      errno = ENOMEM;
+      return ZIP_ERRNO;
+    }
+    cbAlloc *= 2;
+  }
+  if (!(p = realloc(tw->pCentral, cbAlloc))) {
+    errno = ENOMEM;
+    return ZIP_ERRNO;
+  }
+  tw->pCentral = p;
+  tw->cbCentralAlloc = cbAlloc;
+
+  return ZIP_OK;
+}
+
+int TzDeflateInit(z_stream *zs) {
+  memset(zs, 0, sizeof(z_stream));
+  return deflateInit2(zs, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+                      TZ_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+}
+
+// Start a zip on fd, which belongs to the writer from now on unless this
+// fails. cbCentralDir is the expected size of the central directory.
+// Members are deflated with zs, set up by TzDeflateInit.
+TZWRITER *TzWriterCreate(int fd, size_t cbBuffer, size_t cbCentralDir,
+                         z_stream *zs) {
+  TZWRITER *tw = calloc(1, sizeof(TZWRITER));
+
+  if (!tw)
+    return NULL;
+
+  tw->fd = fd;
+  tw->zs = zs;
+  tw->cbBufAlloc = cbBuffer ? cbBuffer : 1;
+  tw->cbCentralAlloc = cbCentralDir ? cbCentralDir : 1024;
+  tw->crcCentral = 0L;
+  if (!(tw->pBuf = malloc(tw->cbBufAlloc)) ||
+      !(tw->pCentral = malloc(tw->cbCentralAlloc))) {
+    free(tw->pBuf);
+    free(tw);
+    return NULL;
+  }
+
+#ifdef WIN32
+  _setmode(fd, _O_BINARY);
+#endif
+
+  return tw;
+}
+
+static int OpenMember(TZWRITER *tw, const char *pszName, int bRaw,
+                      int bZip64, ZPOS64_T cCompressed,
+                      ZPOS64_T cUncompressed, uLong crc) {
+  unsigned char header[LOCAL_HEADER_SIZE + ZIP64_EXTRA_SIZE];
+  unsigned char *p;
+  size_t cchName = strlen(pszName);
+  int bBig, rc;
+
+  if (tw->bOpen || cchName > 0xffff)
+    return ZIP_PARAMERROR;
+
+  // Room for the central header is taken now, its name is filled in
+  // right away
+  if ((rc = CentralReserve(tw, CENTRAL_HEADER_SIZE + cchName +
+                                   ZIP64_CENTRAL_EXTRA_MAX + 4)) != ZIP_OK)
+    return rc;
+  memcpy(tw->pCentral + tw->cbCentral + CENTRAL_HEADER_SIZE, pszName,
+         cchName);
+
+  if (!bRaw && deflateReset(tw->zs) != Z_OK)
+    return ZIP_INTERNALERROR;
+
+  tw->bOpen = 1;
+  tw->bRaw = bRaw;
+  tw->bZip64 = bZip64;
+  tw->cchName = cchName;
+  tw->posHeader = tw->posBuf + tw->cbBuf;
+  tw->cCompressed = 0;
+  tw->cUncompressed = cUncompressed;
+  tw->cCompressedRaw = cCompressed;
+  tw->crcRaw = crc;
+
+  // CRC and sizes are filled in when the member is closed, unless they're
+  // known. Either way, the header ends up the same.
+  bBig = bRaw && (cCompressed >= 0xffffffff || cUncompressed >= 0xffffffff);
+  memcpy(header, LocalHeader, LOCAL_HEADER_SIZE);
+  p = header;
+  if (bRaw) {
+    PutValue(p + 14, crc, 4);
+    PutValue(p + 18, cCompressed, 4);
+    PutValue(p + 22, cUncompressed, 4);
+  }
+  if (bZip64) {
+    PutValue(p + 4, 45, 2);
+    if (!bRaw || bBig) {
+      PutValue(p + 18, 0xffffffff, 4);
+      PutValue(p + 22, 0xffffffff, 4);
+    }
+    memset(p + LOCAL_HEADER_SIZE, 0, ZIP64_EXTRA_SIZE);
+    PutValue(p + LOCAL_HEADER_SIZE, 1, 2);
+    PutValue(p + LOCAL_HEADER_SIZE + 2, 16, 2);
+    if (bBig) {
+      PutValue(p + LOCAL_HEADER_SIZE + 4, cUncompressed, 8);
+      PutValue(p + LOCAL_HEADER_SIZE + 12, cCompressed, 8);
+    }
+  }
+  PutValue(p + 26, cchName, 2);
+  PutValue(p + 28, bZip64 ? ZIP64_EXTRA_SIZE : 0, 2);
+
+  if ((rc = Put(tw, header, LOCAL_HEADER_SIZE)) != ZIP_OK ||
+      (rc = Put(tw, pszName, cchName)) != ZIP_OK)
+    return rc;
+  if (bZip64)
+    rc = Put(tw, header + LOCAL_HEADER_SIZE, ZIP64_EXTRA_SIZE);
+
+  return rc;
+}
+
+// Start a member, its data is deflated by TzWriterWrite
+int TzWriterOpenMember(TZWRITER *tw, const char *pszName, int bZip64) {
+  return OpenMember(tw, pszName, 0, bZip64, 0, 0, 0);
+}
+
+// Start a member whose data is passed to TzWriterWrite already deflated.
+// Its sizes and CRC are known, so the local header is written complete.
+int TzWriterOpenRawMember(TZWRITER *tw, const char *pszName, int bZip64,
+                          ZPOS64_T cCompressed, ZPOS64_T cUncompressed,
+                          uLong crc) {
+  return OpenMember(tw, pszName, 1, bZip64, cCompressed, cUncompressed, crc);
+}
+
+int TzWriterWrite(TZWRITER *tw, const void *pData, unsigned int cbData) {
+  size_t cbOut;
+
+  if (!tw->bOpen)
+    return ZIP_PARAMERROR;
+
+  if (tw->bRaw) {
+    tw->cCompressed += cbData;
+    return Put(tw, pData, cbData);
+  }
+
+  tw->cUncompressed += cbData;
+
+  // Deflate right into the buffer
+  tw->zs->next_in = (Bytef *)(uintptr_t)pData;
+  tw->zs->avail_in = cbData;
+  while (tw->zs->avail_in) {
+    if (tw->cbBuf == tw->cbBufAlloc && Flush(tw) != ZIP_OK)
+      return ZIP_ERRNO;
+    cbOut = tw->cbBufAlloc - tw->cbBuf;
+    if (cbOut > 0x40000000)
+      cbOut = 0x40000000;
+    tw->zs->next_out = tw->pBuf + tw->cbBuf;
+    tw->zs->avail_out = (uInt)cbOut;
+    if (deflate(tw->zs, Z_NO_FLUSH) != Z_OK)
+      return ZIP_INTERNALERROR;
+    tw->cbBuf += cbOut - tw->zs->avail_out;
+    tw->cCompressed += cbOut - tw->zs->avail_out;
+  }
+
+  return ZIP_OK;
+}
+
+// Finish the member. cUncompressed and crc describe its uncompressed
+// data. The data isn't checksummed again here, whoever read it must have
+// checked the CRC already. For a raw member they, and the amount of data
+// written, must be what it was opened with.
+int TzWriterCloseMember(TZWRITER *tw, ZPOS64_T cUncompressed, uLong crc) {
+  unsigned char *p = tw->pCentral + tw->cbCentral;
+  unsigned char value[16];
+  size_t cbOut, cbEntry;
+  unsigned int cbExtra = 0;
+  int bBig, rc = Z_OK;
+
+  if (!tw->bOpen)
+    return ZIP_PARAMERROR;
+  tw->bOpen = 0;
+
+  if (!tw->bRaw) {
+    tw->zs->avail_in = 0;
+    while (rc == Z_OK) {
+      if (tw->cbBuf == tw->cbBufAlloc && Flush(tw) != ZIP_OK)
+        return ZIP_ERRNO;
+      cbOut = tw->cbBufAlloc - tw->cbBuf;
+      if (cbOut > 0x40000000)
+        cbOut = 0x40000000;
+      tw->zs->next_out = tw->pBuf + tw->cbBuf;
+      tw->zs->avail_out = (uInt)cbOut;
+      rc = deflate(tw->zs, Z_FINISH);
+      tw->cbBuf += cbOut - tw->zs->avail_out;
+      tw->cCompressed += cbOut - tw->zs->avail_out;
+    }
+    if (rc != Z_STREAM_END)
+      return ZIP_INTERNALERROR;
+    if (cUncompressed != tw->cUncompressed)
+      return ZIP_PARAMERROR;
+  } else if (tw->cCompressed != tw->cCompressedRaw ||
+             cUncompressed != tw->cUncompressed || crc != tw->crcRaw)
+    return ZIP_PARAMERROR;
+
+  // The central header
+  memcpy(p, CentralHeader, CENTRAL_HEADER_SIZE);
+  if (tw->cCompressed >= 0xffffffff || cUncompressed >= 0xffffffff ||
+      tw->posHeader >= 0xffffffff)
+    PutValue(p + 6, 45, 2);
+  PutValue(p + 16, crc, 4);
+  PutValue(p + 20, tw->cCompressed, 4);
+  PutValue(p + 24, cUncompressed, 4);
+  PutValue(p + 28, tw->cchName, 2);
+  memset(p + 30, 0, CENTRAL_HEADER_SIZE - 30);
+  PutValue(p + 42, tw->posHeader, 4);
+
+  // Zip64 extra field, name is already in place
+  cbEntry = CENTRAL_HEADER_SIZE + tw->cchName;
+  if (cUncompressed >= 0xffffffff) {
+    PutValue(p + cbEntry + 4 + cbExtra, cUncompressed, 8);
+    cbExtra += 8;
+  }
+  if (tw->cCompressed >= 0xffffffff) {
+    PutValue(p + cbEntry + 4 + cbExtra, tw->cCompressed, 8);
+    cbExtra += 8;
+  }
+  if (tw->posHeader >= 0xffffffff) {
+    PutValue(p + cbEntry + 4 + cbExtra, tw->posHeader, 8);
+    cbExtra += 8;
+  }
+  if (cbExtra) {
+    PutValue(p + cbEntry, 1, 2);
+    PutValue(p + cbEntry + 2, cbExtra, 2);
+    PutValue(p + 30, cbExtra + 4, 2);
+    cbEntry += cbExtra + 4;
+  }
+
+  tw->crcCentral = Crc32(tw->crcCentral, p, cbEntry);
+  tw->cbCentral += cbEntry;
+  tw->cEntries++;
+
+  bBig = tw->cCompressed >= 0xffffffff || cUncompressed >= 0xffffffff;
+  if (bBig && !tw->bZip64)
+    return ZIP_BADZIPFILE; // no room for the sizes
+  if (tw->bRaw)
+    return ZIP_OK;
+
+  // Complete the local header
+  PutValue(value, crc, 4);
+  if ((rc = PutAt(tw, tw->posHeader + 14, value, 4)) != ZIP_OK)
+    return rc;
+  if (bBig) {
+    PutValue(value, cUncompressed, 8);
+    PutValue(value + 8, tw->cCompressed, 8);
+    rc = PutAt(tw, tw->posHeader + LOCAL_HEADER_SIZE + tw->cchName + 4, value,
+               16);
+  } else {
+    PutValue(value, tw->cCompressed, 4);
+    PutValue(value + 4, cUncompressed, 4);
+    rc = PutAt(tw, tw->posHeader + 18, value, 8);
+  }
+
+  return rc;
+}
+
+// From now on, add the time spent writing to *pnsWrite and the number of
+// bytes written to *pcbWritten
+void TzWriterCount(TZWRITER *tw, uint64_t *pnsWrite, uint64_t *pcbWritten) {
+  tw->pnsWrite = pnsWrite;
+  tw->pcbWritten = pcbWritten;
+}
+
+// The CRC of the central directory written so far
+uLong TzWriterCentralDirCrc(const TZWRITER *tw) { return tw->crcCentral; }
+
+// How much of the zip has been put together so far, buffered or not
+ZPOS64_T TzWriterOffset(const TZWRITER *tw) { return tw->posBuf + tw->cbBuf; }
+
+// Write the central directory and end records with the archive comment,
+// close the file and free tw
+int TzWriterClose(TZWRITER *tw, const char *pszComment) {
+  unsigned char end[56 + 20 + 22];
+  unsigned char *p = end;
+  ZPOS64_T posCentral = tw->posBuf + tw->cbBuf;
+  size_t cchComment = strlen(pszComment);
+  CHUNK chunks[MAX_CHUNKS];
+  uint64_t nsStart;
+  int rc, err;
+
+  if (tw->bOpen) {
+    TzWriterFree(tw);
+    return ZIP_PARAMERROR;
+  }
+
+  if (posCentral >= 0xffffffff || tw->cEntries >= 0xffff) {
+    // Zip64 end of central directory record
+    memset(p, 0, 56);
+    PutValue(p, 0x06064b50, 4);
+    PutValue(p + 4, 44, 8);
+    PutValue(p + 12, 45, 2);
+    PutValue(p + 14, 45, 2);
+    PutValue(p + 24, tw->cEntries, 8);
+    PutValue(p + 32, tw->cEntries, 8);
+    PutValue(p + 40, tw->cbCentral, 8);
+    PutValue(p + 48, posCentral, 8);
+    p += 56;
+
+    // and its locator
+    PutValue(p, 0x07064b50, 4);
+    PutValue(p + 4, 0, 4);
+    PutValue(p + 8, posCentral + tw->cbCentral, 8);
+    PutValue(p + 16, 1, 4);
+    p += 20;
+  }
+
+  memset(p, 0, 22);
+  PutValue(p, 0x06054b50, 4);
+  PutValue(p + 8, tw->cEntries >= 0xffff ? 0xffff : tw->cEntries, 2);
+  PutValue(p + 10, tw->cEntries >= 0xffff ? 0xffff : tw->cEntries, 2);
+  PutValue(p + 12, tw->cbCentral, 4);
+  PutValue(p + 16, posCentral, 4);
+  PutValue(p + 20, cchComment, 2);
+  p += 22;
+
+  // Whatever is buffered, the central directory and the end records go
+  // out together
+  chunks[0].p = tw->pBuf;
+  chunks[0].cb = tw->cbBuf;
+  chunks[1].p = tw->pCentral;
+  chunks[1].cb = tw->cbCentral;
+  chunks[2].p = end;
+  chunks[2].cb = p - end;
+  chunks[3].p = (const unsigned char *)pszComment;
+  chunks[3].cb = cchComment;
+  tw->cbBuf = 0;
+  rc = WriteChunks(tw, chunks, 4);
+
+  // Network file systems may only report write errors here
+  nsStart = WriteStart(tw);
+  err = close(tw->fd);
+  tw->fd = -1;
+  WriteDone(tw, nsStart, 0);
+  if (rc == ZIP_OK && err)
+    rc = ZIP_ERRNO;
+
+  TzWriterFree(tw);
+
+  return rc;
+}
+
+void TzWriterFree(TZWRITER *tw) {
+  if (tw->fd >= 0)
+    close(tw->fd);
+  free(tw->pCentral);
+  free(tw->pBuf);
+  free(tw);
+}
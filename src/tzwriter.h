@@ -0,0 +1,57 @@
+// Copyright (C) 2005 TorrentZip Team (StatMat,shindakun,Ultrasubmarine,r3nh03k)
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TZWRITER_DOT_H
+#define TZWRITER_DOT_H
+
+#include "global.h"
+
+// Return codes, the same as minizip's zip.h used to give
+#define ZIP_OK 0
+#define ZIP_ERRNO Z_ERRNO
+#define ZIP_PARAMERROR -102
+#define ZIP_BADZIPFILE -103
+#define ZIP_INTERNALERROR -104
+
+// Buffer size for zips too big to be written at once
+#define TZWRITER_BUFFER_SIZE (1024 * 1024)
+
+// Writes a zip in TorrentZip format to an already open file: deflated
+// members with the fixed date and attributes, byte for byte what minizip
+// writes with TorrentZip's settings. Output is collected in a buffer of
+// cbBuffer bytes, so a zip smaller than that is written at once.
+// Functions return ZIP_OK or a ZIP_... error, ZIP_ERRNO with errno set.
+typedef struct _TZWRITER TZWRITER;
+
+// Set up zs to deflate like TorrentZip does. Setting one up costs far more
+// than compressing a small member, so streams are kept and deflateReset
+// for each member.
+int TzDeflateInit(z_stream *zs);
+
+TZWRITER *TzWriterCreate(int fd, size_t cbBuffer, size_t cbCentralDir,
+                         z_stream *zs);
+int TzWriterOpenMember(TZWRITER *tw, const char *pszName, int bZip64);
+int TzWriterOpenRawMember(TZWRITER *tw, const char *pszName, int bZip64,
+                          ZPOS64_T cCompressed, ZPOS64_T cUncompressed,
+                          uLong crc);
+int TzWriterWrite(TZWRITER *tw, const void *pData, unsigned int cbData);
+int TzWriterCloseMember(TZWRITER *tw, ZPOS64_T cUncompressed, uLong crc);
+void TzWriterCount(TZWRITER *tw, uint64_t *pnsWrite, uint64_t *pcbWritten);
+uLong TzWriterCentralDirCrc(const TZWRITER *tw);
+ZPOS64_T TzWriterOffset(const TZWRITER *tw);
+int TzWriterClose(TZWRITER *tw, const char *pszComment);
+void TzWriterFree(TZWRITER *tw);
+
+#endif
@@ -14,49 +14,93 @@
 // with this program; if not, see <https://www.gnu.org/licenses/>.
 
 #include <errno.h>
-#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
-#define NDEBUG
-#include <assert.h>
-
 #include "global.h"
 #include "util.h"
 
 #ifdef _WIN32
 #include <direct.h>
+#include <fcntl.h>
+#include <io.h>
 #else
 #include <unistd.h>
 #endif
 
-// The canonical order is case insensitive, but we need a tie-breaker
-// to avoid ambiguity
-int CanonicalCmp(const char *s1, const char *s2) {
-  int res = strcasecmp(s1, s2);
-  return res ? res : strcmp(s1, s2);
+// The canonical order is case insensitive (like strcasecmp in the C
+// locale), but we need a tie-breaker to avoid ambiguity. Names aren't
+// folded again for every comparison: each name is followed in its string
+// table by a lower case copy, its key (see StringTableAddName), and the
+// first bytes of the part that is sorted by are kept in the entry.
+
+// Fold cch characters to lower case. Written so compilers can vectorize it.
+static void FoldName(char *pszKey, const char *psz, size_t cch) {
+  size_t i;
+
+  for (i = 0; i < cch; i++) {
+    unsigned char c = (unsigned char)psz[i];
+    pszKey[i] = (char)((unsigned)(c - 'A') < 26u ? c + ('a' - 'A') : c);
+  }
+}
+
+// Set up the key of the name at pszName, which was added to a string table
+// with StringTableAddName and doesn't move anymore. With bBasename, entries
+// are sorted by base name first.
+void SortNameInit(SORTNAME *sn, char *pszName, int bBasename) {
+  const char *pszBase = bBasename ? strrchr(pszName, '/') : NULL;
+  const unsigned char *p;
+  int i;
+
+  sn->pszName = pszName;
+  sn->pszKey = pszName + strlen(pszName) + 1;
+  sn->iBase = pszBase ? pszBase + 1 - pszName : 0;
+
+  // Packed big endian, so comparing prefixes orders like strcmp
+  p = (const unsigned char *)sn->pszKey + sn->iBase;
+  sn->Prefix = 0;
+  for (i = 0; i < 8; i++) {
+    sn->Prefix <<= 8;
+    if (*p)
+      sn->Prefix |= *p++;
+  }
+}
+
+// Canonical order of whole names
+int SortNameCmp(const SORTNAME *sn1, const SORTNAME *sn2) {
+  int res = strcmp(sn1->pszKey, sn2->pszKey);
+  return res ? res : strcmp(sn1->pszName, sn2->pszName);
 }
 
-int StringCompare(const void *str1, const void *str2) {
-  const char *p1 = *(const char **)str1;
-  const char *p2 = *(const char **)str2;
-  return CanonicalCmp(p1, p2);
+// Compare ZIPENTRYs or WALKENTRYs in canonical order, for qsort
+int SortNameCompare(const void *p1, const void *p2) {
+  const SORTNAME *sn1 = p1, *sn2 = p2;
+
+  if (sn1->Prefix != sn2->Prefix)
+    return sn1->Prefix < sn2->Prefix ? -1 : 1;
+
+  return SortNameCmp(sn1, sn2);
 }
 
-int BasenameCompare(const void *str1, const void *str2) {
-  const char *p1 = *(const char **)str1;
-  const char *p2 = *(const char **)str2;
-  const char *b1 = strrchr(p1, '/');
-  const char *b2 = strrchr(p2, '/');
-  int res = CanonicalCmp(b1 ? b1 + 1 : p1, b2 ? b2 + 1 : p2);
+// Like SortNameCompare, by base name first (the keys were set up for that)
+int BasenameCompare(const void *p1, const void *p2) {
+  const SORTNAME *sn1 = p1, *sn2 = p2;
+  int res;
+
+  if (sn1->Prefix != sn2->Prefix)
+    return sn1->Prefix < sn2->Prefix ? -1 : 1;
+
+  res = strcmp(sn1->pszKey + sn1->iBase, sn2->pszKey + sn2->iBase);
+  if (!res)
+    res = strcmp(sn1->pszName + sn1->iBase, sn2->pszName + sn2->iBase);
 
   // Tie-breaker ensures deterministic output. (It isn't needed for correct
   // operation since names of added members must be unique.)
-  if (!res && b1 && b2)
-    res = CanonicalCmp(p1, p2);
+  if (!res && sn1->iBase && sn2->iBase)
+    res = SortNameCmp(sn1, sn2);
 
   return res;
 }
@@ -70,126 +114,73 @@ int EndsWithCaseInsensitive(const char *str, const char *tail) {
     return !strcasecmp(str + n1 - n2, tail);
 }
 
-// Create a dynamic string array
-char **DynamicStringArrayCreate(int iElements) {
-  int iCount;
-  char **StringArray;
-
-  StringArray = (char **)calloc(sizeof(char *), iElements);
-  if (!StringArray)
-    return NULL;
-
-  for (iCount = 0; iCount < iElements; iCount++) {
-    StringArray[iCount] = (char *)malloc(MAX_PATH + 1);
+// Make room for a string of up to cbMax bytes (including the NUL) at the
+// end of st, and return where to put it
+char *StringTableReserve(STRINGTABLE *st, size_t cbMax) {
+  size_t cbAlloc = st->cbAlloc ? st->cbAlloc : 4096;
+  char *p;
 
-    // Check for error with above alloc
-    // If there is, free up everything we managed to alloc
-    // and return error
-    if (!StringArray[iCount])
-      return DynamicStringArrayDestroy(StringArray, iCount);
-    StringArray[iCount][0] = 0;
+  while (cbAlloc - st->cbUsed < cbMax) {
+    if (cbAlloc > ((size_t)-1) / 2)
+      return NULL;
+    cbAlloc *= 2;
   }
-  return (StringArray);
-}
 
-// Destroy a dynamic string array
-char **DynamicStringArrayDestroy(char **StringArray, int iElements) {
-  int iCount;
+  if (cbAlloc != st->cbAlloc) {
+    if (!(p = realloc(st->pData, cbAlloc)))
+      return NULL;
+    st->pData = p;
+    st->cbAlloc = cbAlloc;
+  }
 
-  CHECK_DYNAMIC_STRING_ARRAY(StringArray, iElements);
+  return st->pData + st->cbUsed;
+}
 
-  for (iCount = 0; iCount < iElements; iCount++) {
-    free(StringArray[iCount]);
-  }
+// Keep the cch characters put at the reserved place as a string, and
+// return its offset
+size_t StringTableCommit(STRINGTABLE *st, size_t cch) {
+  size_t iOffset = st->cbUsed;
 
-  free(StringArray);
+  st->pData[iOffset + cch] = 0;
+  st->cbUsed += cch + 1;
 
-  return NULL;
+  return iOffset;
 }
 
-// Resize a dynamic string array
-// to have iNewElements in total.
-// iNewElements may be larger or smaller than *piElements.
-char **DynamicStringArrayResize(char **StringArray, int *piElements,
-                                int iNewElements) {
-  int iCount;
-  char **TmpPtr = NULL;
+int StringTableAdd(STRINGTABLE *st, const char *psz, size_t *piOffset) {
+  size_t cch = strlen(psz);
+  char *p = StringTableReserve(st, cch + 1);
 
-  CHECK_DYNAMIC_STRING_ARRAY(StringArray, *piElements);
+  if (!p)
+    return TZ_CRITICAL;
 
-  if (iNewElements < 1) {
-    iCount = *piElements;
-    *piElements = 0;
-    return DynamicStringArrayDestroy(StringArray, iCount);
-  }
+  memcpy(p, psz, cch);
+  *piOffset = StringTableCommit(st, cch);
 
-  for (iCount = iNewElements; iCount < *piElements; iCount++) {
-    free(StringArray[iCount]);
-  }
-  TmpPtr = StringArray;
-  iCount = iNewElements < *piElements ? iNewElements : *piElements;
-  StringArray = (char **)realloc(StringArray, iNewElements * sizeof(char *));
-  if (!StringArray) {
-    *piElements = 0;
-    return DynamicStringArrayDestroy(TmpPtr, iCount);
-  }
+  return TZ_OK;
+}
 
-  for (iCount = *piElements; iCount < iNewElements; iCount++) {
-    StringArray[iCount] = (char *)malloc(MAX_PATH + 1);
+// Add the cch characters at p as a string, followed by their key for
+// sorting (see SortNameInit)
+int StringTableAddName(STRINGTABLE *st, const char *p, size_t cch,
+                       size_t *piOffset) {
+  char *pszName = StringTableReserve(st, 2 * (cch + 1));
 
-    // Check for error with above alloc
-    // If there is, free up everything we managed to alloc
-    // and return error
-    if (!StringArray[iCount]) {
-      *piElements = 0;
-      return DynamicStringArrayDestroy(StringArray, iCount);
-    }
-    StringArray[iCount][0] = 0;
-  }
-  *piElements = iNewElements;
+  if (!pszName)
+    return TZ_CRITICAL;
 
-  CHECK_DYNAMIC_STRING_ARRAY(StringArray, *piElements);
+  memcpy(pszName, p, cch);
+  *piOffset = StringTableCommit(st, cch);
+  FoldName(pszName + cch + 1, p, cch);
+  StringTableCommit(st, cch);
 
-  return (StringArray);
+  return TZ_OK;
 }
 
-// Grow a dynamic string array to support at least iMinElements entries.
-// Balances number of reallocations and wasted space by using geometric
-// growth for tiny expansion requests while obeying large increments
-// exactly. Does nothing when the array is already large enough.
-char **DynamicStringArrayGrow(char **FileNameArray, int *piElements,
-                              int iMinElements) {
-  int iNewElements;
-
-  if (*piElements >= iMinElements && FileNameArray)
-    return FileNameArray;
-  else if (iMinElements - *piElements >= (*piElements + ARRAY_ELEMENTS) / 4)
-    iNewElements = iMinElements;
-  else // grow geometrically
-    iNewElements = *piElements < 2             ? ARRAY_ELEMENTS
-                   : *piElements < INT_MAX / 2 ? *piElements * 2
-                   : *piElements < INT_MAX     ? INT_MAX
-                                               : 0;
-
-  return DynamicStringArrayResize(FileNameArray, piElements, iNewElements);
-}
-
-void DynamicStringArrayCheck(char **StringArray, int iElements) {
-#ifndef NDEBUG
-  // All StringArray elements should be non-null,
-  // because they were all allocated by DynamicStringArrayCreate.
-  int i, l;
-  assert(StringArray || iElements == 0);
-  for (i = 0; i < iElements; ++i) {
-    assert(StringArray[i]);
-    l = strlen(StringArray[i]);
-    assert(l >= 0);
-    assert(l <= MAX_PATH);
-  }
-#else
-  (void)StringArray;
-  (void)iElements;
-#endif
+void StringTableFree(STRINGTABLE *st) {
+  free(st->pData);
+  st->pData = NULL;
+  st->cbUsed = st->cbAlloc = 0;
 }
 
 char *get_cwd(void) {
@@ -219,13 +210,92 @@ char *get_cwd(void) {
   return pszCWD;
 }
 
-// Replaces file dest with tmpfile.
+// Creates the missing directories leading up to file path.
+// Returns 0 on success, or -1 with errno set.
+int MakeParentDirs(const char *path) {
+  char buf[MAX_PATH + 1];
+  struct stat st;
+  char *p;
+
+  snprintf(buf, sizeof(buf), "%s", path);
+  for (p = strchr(buf + 1, DIRSEP); p; p = strchr(p + 1, DIRSEP)) {
+    *p = 0;
+#ifdef _WIN32
+    if (stat(buf, &st) && _mkdir(buf) && errno != EEXIST)
+#else
+    if (stat(buf, &st) && mkdir(buf, 0777) && errno != EEXIST)
+#endif
+      return -1;
+    *p = DIRSEP;
+  }
+
+  return 0;
+}
+
+// Replaces file dest with a copy of src, made next to dest so the
+// replacement itself is a rename.
+// Returns NULL on success or an error message.
+const char *ReplaceWithCopy(const char *dest, const char *src) {
+  char szTmpFile[MAX_PATH + 1];
+  const char *sep = strrchr(dest, DIRSEP);
+  char buf[64 * 1024];
+  FILE *in, *out = NULL;
+  struct stat st;
+  size_t cb;
+  int fd, err = 0;
+
+  snprintf(szTmpFile, sizeof(szTmpFile), "%.*strrntzip-XXXXXX",
+           sep ? (int)(sep - dest + 1) : 0, dest);
+
+  if (!(in = fopen(src, "rb")))
+    return strerror(errno);
+  fd = mkstemp(szTmpFile);
+#ifdef WIN32
+  if (fd >= 0)
+    _setmode(fd, _O_BINARY);
+#endif
+  if (fd < 0 || !(out = fdopen(fd, "wb"))) {
+    err = errno;
+    if (fd >= 0) {
+      close(fd);
+      remove(szTmpFile);
+    }
+    fclose(in);
+    return strerror(err);
+  }
+
+  while ((cb = fread(buf, 1, sizeof(buf), in)) > 0)
+    if (fwrite(buf, 1, cb, out) != cb)
+      break;
+  if (ferror(in) || ferror(out))
+    err = errno ? errno : EIO;
+
+#ifndef WIN32
+  if (!fstat(fileno(in), &st))
+    fchmod(fileno(out), st.st_mode & ~S_IFMT);
+#else
+  (void)st;
+#endif
+
+  fclose(in);
+  if (fclose(out) && !err)
+    err = errno ? errno : EIO;
+  if (err) {
+    remove(szTmpFile);
+    return strerror(err);
+  }
+
+  return UpdateFile(dest, szTmpFile);
+}
+
+// Replaces file dest with tmpfile, which may be on a different file
+// system. dest doesn't have to exist.
 // Returns NULL on success or an error message.
 const char *UpdateFile(const char *dest, const char *tmpfile) {
 #ifdef WIN32
   // On WIN32, rename() fails if the destination exists. So we have to remove
   // the destination first.
-  if (remove(dest)) {
+  if (remove(dest) && errno != ENOENT) {
     if (remove(tmpfile))
       return "Unable to remove either destination or temporary file. "
              "Please replace the file manually.";
@@ -233,12 +303,17 @@ const char *UpdateFile(const char *dest, const char *tmpfile) {
       return "Unable to remove destination for replacement (temporary "
              "file removed).";
   }
-  if (rename(tmpfile, dest))
-    return "The original file has already been deleted, so you must rename "
-           "this file manually.";
+  if (rename(tmpfile, dest)) {
+    if (errno != EXDEV || ReplaceWithCopy(dest, tmpfile))
+      return "The original file has already been deleted, so you must rename "
+             "this file manually.";
+    remove(tmpfile);
+  }
 
 #else // !WIN32, assume POSIX semantics
 
+  const char *pErr;
+
   // Try to preserve permissions but ignore errors
   struct stat st;
   if (!stat(dest, &st))
@@ -247,6 +322,12 @@ const char *UpdateFile(const char *dest, const char *tmpfile) {
   // On a POSIX system, rename() atomically replaces the destination if
   // it exists.
   if (rename(tmpfile, dest)) {
+    // Copy across file systems, which is still atomic for dest
+    if (errno == EXDEV) {
+      pErr = ReplaceWithCopy(dest, tmpfile);
+      remove(tmpfile);
+      return pErr;
+    }
     if (remove(tmpfile))
       return "Also could not remove temporary file. "
              "Please replace the file manually.";
@@ -18,26 +18,27 @@
 
 #define ARRAY_ELEMENTS 256
 
-int CanonicalCmp(const char *s1, const char *s2);
-int StringCompare(const void *str1, const void *str2);
-int BasenameCompare(const void *str1, const void *str2);
+void SortNameInit(SORTNAME *sn, char *pszName, int bBasename);
+int SortNameCmp(const SORTNAME *sn1, const SORTNAME *sn2);
+int SortNameCompare(const void *p1, const void *p2);
+int BasenameCompare(const void *p1, const void *p2);
 
 int EndsWithCaseInsensitive(const char *str, const char *tail);
 
-char **DynamicStringArrayCreate(int iElements);
-char **DynamicStringArrayDestroy(char **StringArray, int iElements);
-char **DynamicStringArrayResize(char **StringArray, int *piElements,
-                                int iNewElements);
-char **DynamicStringArrayGrow(char **FileNameArray, int *piElements,
-                              int iMinElements);
-void DynamicStringArrayCheck(char **StringArray, int iElements);
-#ifdef NDEBUG
-#define CHECK_DYNAMIC_STRING_ARRAY(StringArray, iElements)
-#else
-#define CHECK_DYNAMIC_STRING_ARRAY(StringArray, iElements)                     \
-  DynamicStringArrayCheck(StringArray, iElements)
-#endif
+// A STRINGTABLE (see global.h) needs memory for the bytes of its strings
+// only. Strings are referred to by their offset while adding, since the
+// buffer may move. Emptying it keeps the buffer for reuse.
+char *StringTableReserve(STRINGTABLE *st, size_t cbMax);
+size_t StringTableCommit(STRINGTABLE *st, size_t cch);
+int StringTableAdd(STRINGTABLE *st, const char *psz, size_t *piOffset);
+int StringTableAddName(STRINGTABLE *st, const char *p, size_t cch,
+                       size_t *piOffset);
+void StringTableFree(STRINGTABLE *st);
+#define StringTableReset(st) ((st)->cbUsed = 0)
+#define StringTableString(st, iOffset) ((st)->pData + (iOffset))
 
 char *get_cwd(void);
+int MakeParentDirs(const char *path);
+const char *ReplaceWithCopy(const char *dest, const char *src);
 const char *UpdateFile(const char *dest, const char *tmpfile);
 #endif